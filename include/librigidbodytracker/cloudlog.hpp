@@ -1,5 +1,9 @@
 #pragma once
 
+#ifndef LIBRIGIDBODYTRACKER_WITH_PCL
+#error "cloudlog.hpp requires librigidbodytracker built with LIBRIGIDBODYTRACKER_WITH_PCL"
+#endif
+
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include "librigidbodytracker/rigid_body_tracker.h"
@@ -168,7 +172,7 @@ namespace librigidbodytracker {
 			auto eig2pcl = [](Eigen::Vector3f v) {
 			  return pcl::PointXYZ(v.x(), v.y(), v.z());
 			};
-			auto pcl2eig =[](Point p) {
+			auto pt2eig =[](const pcl::PointXYZ& p) {
 			  return Eigen::Vector3f(p.x, p.y, p.z);
 			};
 
@@ -190,10 +194,10 @@ namespace librigidbodytracker {
 					std::cout << "RigidBody vector size: " << rigidBodies.size() << "\n";
 					std::cout << "RigidBody " << a << " processing\n";
 					//debugging stuff
-					Cloud::Ptr &rbMarkers = config[rigidBody.m_markerConfigurationIdx];
+					const MarkerConfiguration &rbMarkers = config[rigidBody.m_markerConfigurationIdx];
 					size_t const rbNpts = rbMarkers->size();
 					for (size_t j = 0; j < rbNpts; ++j) { //for each marker
-						auto p = rigidBody.transformation() * pcl2eig((*rbMarkers)[j]); //get real position
+						auto p = rigidBody.transformation() * pt2eig((*rbMarkers)[j]); //get real position
 						matches.back()->push_back(eig2pcl(p));
 					}
 				}
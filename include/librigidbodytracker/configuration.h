@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "librigidbodytracker/rigid_body_tracker.h"
+
+namespace librigidbodytracker {
+
+  // Everything needed to construct a RigidBodyTracker. Marker
+  // configurations have their offset applied, and rigid bodies refer to
+  // configurations by index.
+  struct TrackerConfiguration
+  {
+    std::vector<DynamicsConfiguration> dynamicsConfigurations;
+    std::vector<MarkerConfiguration> markerConfigurations;
+    std::vector<RigidBody> rigidBodies;
+    bool usePrefilter = false;
+    PrefilterConfiguration prefilter;
+  };
+
+  // Throws std::runtime_error describing the first problem found, e.g., an
+  // empty marker configuration or a configuration index out of range.
+  void validateConfiguration(const TrackerConfiguration& configuration);
+
+  // Binary cache of a validated configuration. The file is read with a
+  // single read; loading returns false if the file is missing, corrupt, of
+  // another format version, or (if sourceHash != 0) was written for other
+  // source contents.
+  void saveConfigurationCache(const TrackerConfiguration& configuration,
+    const std::string& cacheFile, uint64_t sourceHash = 0);
+
+  bool loadConfigurationCache(const std::string& cacheFile,
+    TrackerConfiguration& configuration, uint64_t sourceHash = 0);
+
+  // FNV-1a hash of the configuration source, used to invalidate caches
+  uint64_t configurationSourceHash(const std::string& source);
+
+#ifdef LIBRIGIDBODYTRACKER_WITH_YAML
+  // Parses and validates a YAML configuration (see example/cfg_000.yaml).
+  // Throws std::runtime_error on invalid input.
+  TrackerConfiguration loadConfiguration(const std::string& yamlFile);
+
+  // Same as above, but uses cacheFile if it was built from the current
+  // contents of yamlFile, and (re-)writes it otherwise.
+  TrackerConfiguration loadConfiguration(const std::string& yamlFile,
+    const std::string& cacheFile);
+#endif
+
+} // namespace librigidbodytracker
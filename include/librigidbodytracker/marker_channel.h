@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <string>
+
+#include "librigidbodytracker/marker_view.h"
+
+namespace librigidbodytracker {
+
+  class SharedMemory;
+
+  // Layout of the marker channel, a POSIX shared memory segment with a
+  // single-producer single-consumer ring of marker frames: a
+  // MarkerChannelHeader followed by numSlots slots of slotSize bytes. Each
+  // slot is a MarkerSlotHeader, followed by maxMarkers x, y, z float
+  // triplets (m) and maxMarkers uint32 marker ids, i.e., the raw buffer
+  // layout of MarkerView. Host byte order.
+  static const uint32_t MarkerChannelVersion = 1;
+
+  struct MarkerChannelHeader
+  {
+    // "LRBTMRK\0"
+    char magic[8];
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t maxMarkers;
+    uint32_t slotSize;
+    uint8_t reserved0[40];
+    // written by the producer: frames pushed, and frames dropped because
+    // the ring was full
+    std::atomic<uint64_t> writeCount;
+    std::atomic<uint64_t> droppedCount;
+    uint8_t reserved1[48];
+    // written by the consumer: frames released; frame f lives in slot
+    // f % numSlots
+    std::atomic<uint64_t> readCount;
+    uint8_t reserved2[56];
+  };
+
+  struct MarkerSlotHeader
+  {
+    // ns; passed to the tracker as frame stamp
+    int64_t stamp;
+    uint32_t numMarkers;
+    // nonzero if the ids are valid
+    uint32_t hasIds;
+    uint8_t reserved[48];
+  };
+
+  static_assert(sizeof(MarkerChannelHeader) == 192, "unexpected marker channel layout");
+  static_assert(sizeof(MarkerSlotHeader) == 64, "unexpected marker channel layout");
+
+  /*! \brief Writes marker frames into a marker channel, e.g., in the
+  process of the motion capture driver
+
+  Creates the segment (replacing a stale one of the same name) and removes
+  the name again on destruction; a consumer has to be reopened if the
+  producer restarts.
+  */
+  class MarkerChannelProducer
+  {
+  public:
+    MarkerChannelProducer(const std::string& name, size_t maxMarkers, size_t numSlots = 8);
+    ~MarkerChannelProducer();
+
+    // Copies the frame into the next free slot. If the consumer fell behind
+    // and the ring is full, the frame is dropped and false returned. Markers
+    // beyond maxMarkers are ignored.
+    bool push(std::chrono::high_resolution_clock::time_point stamp,
+      const MarkerView& markers);
+
+    // frames waiting for the consumer
+    size_t pending() const;
+    size_t numSlots() const;
+    uint64_t droppedCount() const;
+
+  private:
+    std::unique_ptr<SharedMemory> m_memory;
+    MarkerChannelHeader* m_header;
+  };
+
+  /*! \brief Reads marker frames from a marker channel in order
+
+  Frames are read in place: peek() returns a view into the slot, which stays
+  valid (and is not overwritten by the producer) until release().
+  */
+  class MarkerChannelConsumer
+  {
+  public:
+    // throws std::runtime_error if the channel does not exist or has an
+    // unknown layout
+    explicit MarkerChannelConsumer(const std::string& name);
+    ~MarkerChannelConsumer();
+
+    // oldest frame not released yet; false if there is none
+    bool peek(std::chrono::high_resolution_clock::time_point& stamp,
+      MarkerView& markers) const;
+
+    // hands the slot of the frame returned by peek() back to the producer
+    void release();
+
+    size_t pending() const;
+    uint64_t droppedCount() const;
+
+  private:
+    std::unique_ptr<SharedMemory> m_memory;
+    MarkerChannelHeader* m_header;
+  };
+
+} // namespace librigidbodytracker
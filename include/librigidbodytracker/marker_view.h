@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <stdint.h>
+
+namespace librigidbodytracker {
+
+  // Non-owning view of marker positions (m) stored as float triplets, e.g.,
+  // the receive buffer of a motion capture driver. The memory only has to
+  // stay valid for the duration of the call it is passed to.
+  struct MarkerView
+  {
+    MarkerView(const float* data, size_t count,
+      size_t stride = 3 * sizeof(float), const uint32_t* ids = nullptr)
+      : data(data)
+      , count(count)
+      , stride(stride)
+      , ids(ids)
+    {
+    }
+
+    // x, y, z of marker i
+    const float* marker(size_t i) const {
+      return reinterpret_cast<const float*>(
+        reinterpret_cast<const uint8_t*>(data) + i * stride);
+    }
+
+    const float* data;
+    size_t count;
+    // bytes from one marker to the next
+    size_t stride;
+    // optional marker ids that are stable across frames (count entries)
+    const uint32_t* ids;
+  };
+
+} // namespace librigidbodytracker
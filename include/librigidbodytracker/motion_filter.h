@@ -0,0 +1,60 @@
+#pragma once
+#include <chrono>
+
+#include <Eigen/Core>
+
+namespace librigidbodytracker {
+
+  class RigidBodyTracker;
+
+  // Constant-velocity Kalman filter on the position of a rigid body. The
+  // axes are decoupled (white acceleration noise per axis), so the state
+  // covariance is kept as three 2x2 blocks.
+  class MotionFilter
+  {
+  public:
+    MotionFilter();
+
+    bool initialized() const { return m_initialized; }
+
+    // starts over at position with zero velocity
+    void reset(std::chrono::high_resolution_clock::time_point stamp,
+      const Eigen::Vector3f& position,
+      const Eigen::Vector3f& velocityVariance,
+      double measurementVariance);
+
+    // predicts to stamp and fuses a position measurement
+    void update(std::chrono::high_resolution_clock::time_point stamp,
+      const Eigen::Vector3f& position,
+      double processNoise,
+      double measurementVariance);
+
+    // predicted position and its variance per axis at stamp; does not
+    // change the filter state
+    void predict(std::chrono::high_resolution_clock::time_point stamp,
+      double processNoise,
+      Eigen::Vector3f& position,
+      Eigen::Vector3f& positionVariance) const;
+
+    const Eigen::Vector3f& position() const { return m_position; }
+    const Eigen::Vector3f& velocity() const { return m_velocity; }
+    const Eigen::Vector3f& positionVariance() const { return m_varPosition; }
+    const Eigen::Vector3f& velocityVariance() const { return m_varVelocity; }
+
+    std::chrono::high_resolution_clock::time_point stamp() const { return m_stamp; }
+
+  private:
+    bool m_initialized;
+    std::chrono::high_resolution_clock::time_point m_stamp;
+    Eigen::Vector3f m_position;
+    Eigen::Vector3f m_velocity;
+    // covariance blocks per axis: [varPosition, cov; cov, varVelocity]
+    Eigen::Vector3f m_varPosition;
+    Eigen::Vector3f m_cov;
+    Eigen::Vector3f m_varVelocity;
+
+    // saves and restores the state in checkpoints
+    friend RigidBodyTracker;
+  };
+
+} // namespace librigidbodytracker
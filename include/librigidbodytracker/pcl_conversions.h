@@ -0,0 +1,31 @@
+#pragma once
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "librigidbodytracker/point_cloud.h"
+
+namespace librigidbodytracker {
+
+  // Conversions between the core point cloud and PCL; only available if
+  // the library was built with LIBRIGIDBODYTRACKER_WITH_PCL.
+  inline PointCloud::Ptr fromPCL(const pcl::PointCloud<pcl::PointXYZ>& cloud)
+  {
+    PointCloud::Ptr result(new PointCloud);
+    result->reserve(cloud.size());
+    for (const pcl::PointXYZ& p : cloud) {
+      result->push_back(PointXYZ(p.x, p.y, p.z));
+    }
+    return result;
+  }
+
+  inline pcl::PointCloud<pcl::PointXYZ>::Ptr toPCL(const PointCloud& cloud)
+  {
+    pcl::PointCloud<pcl::PointXYZ>::Ptr result(new pcl::PointCloud<pcl::PointXYZ>);
+    result->reserve(cloud.size());
+    for (const PointXYZ& p : cloud) {
+      result->push_back(pcl::PointXYZ(p.x, p.y, p.z));
+    }
+    return result;
+  }
+
+} // namespace librigidbodytracker
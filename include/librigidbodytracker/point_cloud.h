@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace librigidbodytracker {
+
+  struct PointXYZ
+  {
+    PointXYZ() : x(0), y(0), z(0) {}
+    PointXYZ(float x, float y, float z) : x(x), y(y), z(z) {}
+
+    float x;
+    float y;
+    float z;
+  };
+
+  // Point container used by the tracking core. It mirrors the subset of
+  // pcl::PointCloud the tracker needs, so PCL is only required for the
+  // adapter layer.
+  class PointCloud
+  {
+  public:
+    typedef PointXYZ PointType;
+    typedef std::shared_ptr<PointCloud> Ptr;
+    typedef std::shared_ptr<const PointCloud> ConstPtr;
+    typedef std::vector<PointXYZ>::iterator iterator;
+    typedef const PointXYZ* const_iterator;
+
+    PointCloud() : m_view(nullptr), m_viewSize(0) {}
+    // copies of a view own their points
+    PointCloud(const PointCloud& other)
+      : points(other.begin(), other.end()), m_view(nullptr), m_viewSize(0) {}
+    PointCloud& operator=(const PointCloud& other) {
+      if (this != &other) {
+        points.assign(other.begin(), other.end());
+        m_view = nullptr;
+        m_viewSize = 0;
+      }
+      return *this;
+    }
+
+    // Read-only cloud over count points owned by the caller, which have to
+    // outlive it. Nothing is copied.
+    static ConstPtr view(const PointXYZ* data, size_t count) {
+      Ptr cloud(new PointCloud);
+      cloud->m_view = data;
+      cloud->m_viewSize = count;
+      return cloud;
+    }
+
+    size_t size() const { return m_view ? m_viewSize : points.size(); }
+    bool empty() const { return size() == 0; }
+    void clear() { points.clear(); }
+    void reserve(size_t n) { points.reserve(n); }
+    void resize(size_t n) { points.resize(n); }
+    void push_back(const PointXYZ& p) { points.push_back(p); }
+
+    PointXYZ& operator[](size_t i) { return points[i]; }
+    const PointXYZ& operator[](size_t i) const { return m_view ? m_view[i] : points[i]; }
+
+    iterator begin() { return points.begin(); }
+    iterator end() { return points.end(); }
+    const_iterator begin() const { return m_view ? m_view : points.data(); }
+    const_iterator end() const { return begin() + size(); }
+
+    std::vector<PointXYZ> points;
+
+  private:
+    const PointXYZ* m_view;
+    size_t m_viewSize;
+  };
+
+} // namespace librigidbodytracker
@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace librigidbodytracker {
+
+  class RigidBody;
+  class SharedMemory;
+
+  // Layout of the pose channel, a POSIX shared memory segment with a ring of
+  // frames: a PoseChannelHeader followed by numSlots slots of slotSize bytes.
+  // Each slot is a PoseSlotHeader followed by maxRigidBodies PublishedPose
+  // entries. Only meant for processes on the same machine (host byte order).
+  static const uint32_t PoseChannelVersion = 1;
+
+  struct PoseChannelHeader
+  {
+    // "LRBTPOS\0"
+    char magic[8];
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t maxRigidBodies;
+    uint32_t slotSize;
+    // frames published so far; frame f lives in slot f % numSlots
+    std::atomic<uint64_t> frameCount;
+    uint8_t reserved[32];
+  };
+
+  struct PoseSlotHeader
+  {
+    // 2 * f + 1 while frame f is written, 2 * f + 2 afterwards
+    std::atomic<uint64_t> seq;
+    // ns; same clock as the stamps passed to the tracker
+    int64_t stamp;
+    uint32_t numRigidBodies;
+    uint8_t reserved[44];
+  };
+
+  struct PublishedPose
+  {
+    // NUL-terminated, truncated if longer
+    char name[32];
+    float position[3];
+    // x, y, z, w; identity without orientation
+    float orientation[4];
+    uint8_t valid;
+    uint8_t hasOrientation;
+    uint8_t reserved[2];
+  };
+
+  static_assert(sizeof(PoseChannelHeader) == 64, "unexpected pose channel layout");
+  static_assert(sizeof(PoseSlotHeader) == 64, "unexpected pose channel layout");
+  static_assert(sizeof(PublishedPose) == 64, "unexpected pose channel layout");
+
+  /*! \brief Writes the poses of every frame into a pose channel
+
+  Creates the segment (replacing a stale one of the same name) and removes
+  the name again on destruction. Rigid bodies beyond maxRigidBodies are not
+  published.
+  */
+  class PosePublisher
+  {
+  public:
+    PosePublisher(const std::string& name, size_t maxRigidBodies, size_t numSlots = 16);
+    ~PosePublisher();
+
+    void publish(std::chrono::high_resolution_clock::time_point stamp,
+      const std::vector<RigidBody>& rigidBodies);
+
+    uint64_t frameCount() const;
+
+  private:
+    std::unique_ptr<SharedMemory> m_memory;
+    PoseChannelHeader* m_header;
+  };
+
+  struct PublishedFrame
+  {
+    // index of the frame since the publisher started
+    uint64_t frame;
+    std::chrono::high_resolution_clock::time_point stamp;
+    std::vector<PublishedPose> poses;
+  };
+
+  /*! \brief Reads frames from a pose channel of another process
+
+  Reads are wait-free: the publisher never waits for subscribers, and a
+  read that overlaps with the publisher overwriting the slot fails instead
+  of retrying indefinitely.
+  */
+  class PoseSubscriber
+  {
+  public:
+    // throws std::runtime_error if the channel does not exist or has an
+    // unknown layout
+    explicit PoseSubscriber(const std::string& name);
+    ~PoseSubscriber();
+
+    // number of frames published so far; poll this for new frames
+    uint64_t frameCount() const;
+
+    // Copies the given frame; false if it was not published yet or already
+    // overwritten, i.e., more than numSlots frames behind.
+    bool read(uint64_t frame, PublishedFrame& result) const;
+
+    // newest frame; false if none was published yet
+    bool readLatest(PublishedFrame& result) const;
+
+  private:
+    std::unique_ptr<SharedMemory> m_memory;
+    const PoseChannelHeader* m_header;
+  };
+
+} // namespace librigidbodytracker
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+
+#include <Eigen/Geometry>
+
+namespace librigidbodytracker {
+
+  // state of a rigid body at stamp
+  struct PoseEstimate
+  {
+    std::chrono::high_resolution_clock::time_point stamp;
+    Eigen::Vector3f position;
+    // identity for bodies tracked without orientation
+    Eigen::Quaternionf orientation;
+    Eigen::Vector3f velocity;
+    bool hasOrientation;
+  };
+
+  /*! \brief Ring of the most recent states of one rigid body
+
+  Written by a single thread (the tracker), read lock-free by any number of
+  threads: every slot is guarded by a sequence counter, and readers retry if
+  the writer touched a slot while they were reading it.
+  */
+  class PoseHistory
+  {
+  public:
+    // maxExtrapolation (s): how far at() predicts beyond the newest state
+    PoseHistory(size_t capacity, double maxExtrapolation);
+
+    PoseHistory(const PoseHistory&) = delete;
+    PoseHistory& operator=(const PoseHistory&) = delete;
+
+    // Appends a state; stamps have to be increasing. Single writer only.
+    void push(const PoseEstimate& state);
+
+    // newest state; false if there is none
+    bool latest(PoseEstimate& state) const;
+
+    // State at stamp: interpolated between the enclosing states (slerp for
+    // the orientation), or extrapolated from the newest state with constant
+    // velocity and orientation. False if stamp is older than the history or
+    // more than maxExtrapolation newer than the newest state.
+    bool at(std::chrono::high_resolution_clock::time_point stamp, PoseEstimate& state) const;
+
+    size_t capacity() const { return m_capacity; }
+    double maxExtrapolation() const { return m_maxExtrapolation; }
+
+  private:
+    // position, orientation (x, y, z, w), velocity, hasOrientation
+    static const size_t NumValues = 11;
+
+    struct Slot
+    {
+      // 2 * index + 1 while being written, 2 * index + 2 afterwards
+      std::atomic<uint64_t> seq;
+      std::atomic<int64_t> stamp;
+      std::atomic<float> values[NumValues];
+    };
+
+    // reads the state with the given index; false if it was overwritten
+    bool read(uint64_t index, PoseEstimate& state) const;
+
+  private:
+    size_t m_capacity;
+    double m_maxExtrapolation;
+    std::unique_ptr<Slot[]> m_slots;
+    // number of states pushed so far
+    std::atomic<uint64_t> m_count;
+  };
+
+} // namespace librigidbodytracker
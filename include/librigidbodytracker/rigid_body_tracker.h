@@ -2,17 +2,38 @@
 #include <cstddef>
 #include <stdint.h>
 #include <chrono>
-
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
+#include <functional>
+#include <map>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <string>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include "librigidbodytracker/marker_view.h"
+#include "librigidbodytracker/motion_filter.h"
+#include "librigidbodytracker/point_cloud.h"
+#include "librigidbodytracker/pose_history.h"
+
+#ifdef LIBRIGIDBODYTRACKER_WITH_PCL
+#include "librigidbodytracker/pcl_conversions.h"
+#endif
 
 namespace librigidbodytracker {
 
+  // how a rigid body is tracked; decided per body by the number of markers
+  // of its configuration and whether its orientation is needed
   enum TrackingMode {
+    // single marker: assignment of markers to predicted positions
     PositionMode,
+    // several markers: registration of the marker configuration
     PoseMode,
-    HybridMode
+    // several markers, position only: the center follows the centroid of
+    // the assigned markers; the orientation found at acquisition is kept
+    CentroidMode
   };
 
   struct DynamicsConfiguration
@@ -26,9 +47,80 @@ namespace librigidbodytracker {
     double maxRoll;
     double maxPitch;
     double maxFitnessScore;
+    // position-only multi-marker bodies: the mean squared distance (m^2) of
+    // their markers to the marker centroid may deviate at most this much
+    // from that of the marker configuration
+    double maxSpreadDeviation = 1e-4;
+    // a rigid body without valid estimate for longer than this (s) is
+    // re-acquired, using the markers not claimed by tracked bodies
+    double reinitTimeout = 0.4;
+    // single-marker bodies consider at most this many of the markers
+    // reachable under the velocity limits, closest first
+    size_t maxMarkerCandidates = 5;
+    // ICP termination criteria while tracking; epsilons <= 0 are disabled
+    int icpMaxIterations = 5;
+    double icpTransformationEpsilon = 0;
+    double icpFitnessEpsilon = 0;
+    // scale the iteration budget between icpMinIterations and
+    // icpMaxIterations by the predicted motion and last frame's residual
+    bool icpAdaptiveIterations = false;
+    int icpMinIterations = 2;
+    // Constant-velocity Kalman filter on the body position. If enabled, the
+    // filter predicts the position for gating and ICP seeding, and its
+    // covariance (gateSigma standard deviations) sizes the gates instead of
+    // the velocity limits, which remain an upper bound.
+    bool useMotionFilter = false;
+    // white acceleration noise (m^2/s^3)
+    double motionProcessNoise = 100;
+    // position measurement noise (m^2)
+    double measurementNoise = 1e-6;
+    double gateSigma = 4;
+    // states kept per rigid body for poseAt()
+    size_t poseHistorySize = 32;
+    // poseAt() extrapolates at most this far (s) beyond the newest state
+    double maxExtrapolation = 0.05;
+  };
+
+  // Filtering of the raw markers before any tracking stage. Each check is
+  // disabled by default.
+  struct PrefilterConfiguration
+  {
+    // markers outside of [lowerBound, upperBound] are dropped
+    bool useBoundingBox = false;
+    Eigen::Vector3f lowerBound = Eigen::Vector3f::Zero();
+    Eigen::Vector3f upperBound = Eigen::Vector3f::Zero();
+    // markers farther than this (m) from the marker configuration of every
+    // rigid body at its predicted position are dropped; <= 0 disables
+    float gatingDistance = 0;
+    // markers have to be seen in this many consecutive frames, i.e., within
+    // persistenceRadius (m) of a marker of the previous frame; <= 1 disables
+    size_t minPersistence = 0;
+    float persistenceRadius = 0.01;
+  };
+
+  // number of markers dropped by the prefilter in the last frame, by reason
+  struct PrefilterStatistics
+  {
+    size_t inputMarkers = 0;
+    size_t outsideVolume = 0;
+    size_t notPersistent = 0;
+    size_t outsideGates = 0;
+    size_t outputMarkers = 0;
+
+    size_t dropped() const { return inputMarkers - outputMarkers; }
+  };
+
+  // frames handed to the newest-frame ingest, and what became of them
+  struct IngestStatistics
+  {
+    size_t submittedFrames = 0;
+    size_t processedFrames = 0;
+    // superseded by a newer frame before the tracker got to them
+    size_t skippedFrames = 0;
   };
 
   class RigidBodyTracker;
+  class ShardedRigidBodyTracker;
   class PointCloudDebugger;
   class RigidBody
   {
@@ -42,12 +134,30 @@ namespace librigidbodytracker {
     const Eigen::Affine3f& transformation() const;
     Eigen::Vector3f center() const { return m_lastTransformation.translation(); }
     bool orientationAvailable() const { return m_hasOrientation; }
+    TrackingMode trackingMode() const { return m_trackingMode; }
+
+    // Multi-marker bodies whose orientation is not needed are tracked in
+    // CentroidMode, which skips the registration and needs all markers
+    // visible. As the orientation is not updated, the center is off by the
+    // rotation since acquisition applied to the offset between body origin
+    // and marker centroid; place the origin at the centroid to avoid it. Use
+    // RigidBodyTracker::setPositionOnly() for bodies already tracked.
+    bool positionOnly() const { return m_positionOnly; }
+    void setPositionOnly(bool positionOnly) { m_positionOnly = positionOnly; }
 
     const Eigen::Affine3f& initialTransformation() const;
     Eigen::Vector3f initialCenter() const { return m_initialTransformation.translation(); }
 
     bool lastTransformationValid() const;
 
+    // false until the rigid body was found for the first time, and again
+    // while it is being re-acquired after it was lost
+    bool initialized() const { return m_initialized; }
+
+    // filtered position and velocity; only updated if the dynamics
+    // configuration enables the motion filter
+    const MotionFilter& motionFilter() const { return m_motionFilter; }
+
     std::chrono::time_point<std::chrono::high_resolution_clock> lastValidTime() const {
       return m_lastValidTransform;
     }
@@ -56,22 +166,61 @@ namespace librigidbodytracker {
       return m_name;
     }
 
+    size_t markerConfigurationIdx() const { return m_markerConfigurationIdx; }
+    size_t dynamicsConfigurationIdx() const { return m_dynamicsConfigurationIdx; }
+
+    // recent states of this body; shared by all copies of it and safe to
+    // query from any thread while the tracker runs. Null until the body was
+    // passed to a tracker.
+    std::shared_ptr<const PoseHistory> poseHistory() const { return m_poseHistory; }
+
   private:
     size_t m_markerConfigurationIdx;
     size_t m_dynamicsConfigurationIdx;
     Eigen::Affine3f m_lastTransformation;
     bool m_hasOrientation;
-    const Eigen::Affine3f m_initialTransformation;
+    Eigen::Affine3f m_initialTransformation;
     Eigen::Vector3f m_velocity;
     std::chrono::time_point<std::chrono::high_resolution_clock> m_lastValidTransform;
     bool m_lastTransformationValid;
     std::string m_name;
+    // time (s) the last update of this body took; used as scheduling hint
+    double m_updateCost;
+    bool m_initialized;
+    // ICP fitness score of the last accepted pose
+    double m_fitnessScore;
+    // ICP iterations spent on this body in the current frame
+    size_t m_icpIterations;
+    MotionFilter m_motionFilter;
+    TrackingMode m_trackingMode;
+    bool m_positionOnly;
+    // failed (re-)initialization attempts in a row
+    size_t m_initAttempts;
+    // frame number of the next (re-)initialization attempt
+    size_t m_nextInitAttempt;
+    std::shared_ptr<PoseHistory> m_poseHistory;
 
     friend RigidBodyTracker;
+    friend ShardedRigidBodyTracker;
     friend PointCloudDebugger;
   };
 
+  // Marker positions of a rigid body in its frame. PCL builds keep the PCL
+  // cloud, so existing callers are unaffected; the tracker converts it once.
+#ifdef LIBRIGIDBODYTRACKER_WITH_PCL
   typedef pcl::PointCloud<pcl::PointXYZ>::Ptr MarkerConfiguration;
+#else
+  typedef PointCloud::Ptr MarkerConfiguration;
+#endif
+  typedef MarkerConfiguration::element_type MarkerCloud;
+
+  class TaskScheduler;
+  class ReacquisitionWorker;
+  class PosePublisher;
+  class MarkerChannelConsumer;
+  class LatestFrameWorker;
+  class MarkerPrefilter;
+  struct MarkerConfigurationDescriptor;
 
   class RigidBodyTracker
   {
@@ -81,52 +230,296 @@ namespace librigidbodytracker {
       const std::vector<MarkerConfiguration>& markerConfigurations,
       const std::vector<RigidBody>& rigidBodies);
 
+    ~RigidBodyTracker();
+
     void update(
-      pcl::PointCloud<pcl::PointXYZ>::Ptr pointCloud);
+      PointCloud::Ptr pointCloud);
 
     // for faster-than-real-time file playback
     void update(std::chrono::high_resolution_clock::time_point stamp,
-      pcl::PointCloud<pcl::PointXYZ>::Ptr pointCloud,std::string inputPath = "");
+      PointCloud::Ptr pointCloud,std::string inputPath = "");
+
+    // Same as above, but reads the markers from a caller-owned buffer, so
+    // drivers do not need to build a point cloud per frame. Tightly packed
+    // triplets (the default stride) are tracked in place; other strides are
+    // copied once into storage reused across frames. Marker ids, if
+    // present, are used by the prefilter's persistence check.
+    void update(std::chrono::high_resolution_clock::time_point stamp,
+      const MarkerView& markers);
+
+    // Processes the oldest frame of a shared memory marker channel, read in
+    // place, and releases its slot afterwards. With newestOnly, older frames
+    // waiting in the channel are skipped (and counted in ingestStatistics()).
+    // Returns false if the channel had no frame.
+    bool updateFromChannel(MarkerChannelConsumer& channel, bool newestOnly = false);
+
+    // Newest-frame ingest for producers that must not block: frames are
+    // processed on a background thread, and a frame still waiting when a
+    // newer one is submitted is skipped rather than queued, so latency stays
+    // bounded by one frame. Gating and velocities use the frame stamps, so
+    // skipped frames only widen the gates. Results are available through the
+    // rigid body callback and the pose publisher. Do not mix with update()
+    // or updateAsync().
+    void submitLatest(std::chrono::high_resolution_clock::time_point stamp,
+      PointCloud::Ptr pointCloud);
+
+    // True while a submitted frame waits for the previous one to finish,
+    // i.e., the producer is ahead of the tracker; producers may react by
+    // decimating frames before submitting them.
+    bool backpressure() const;
+
+    // blocks until all submitted frames were processed or skipped
+    void waitLatest();
+
+    IngestStatistics ingestStatistics() const;
+
+    struct FrameResult
+    {
+      std::chrono::high_resolution_clock::time_point stamp;
+      std::vector<RigidBody> rigidBodies;
+    };
+
+    // Processes the frame on a background thread. Frames are processed in
+    // submission order. While an asynchronous update is pending, use the
+    // returned result (or the rigid body callback) instead of rigidBodies().
+    std::shared_future<FrameResult> updateAsync(
+      std::chrono::high_resolution_clock::time_point stamp,
+      PointCloud::Ptr pointCloud);
+
+#ifdef LIBRIGIDBODYTRACKER_WITH_PCL
+    // PCL adapters; the cloud is copied into the core representation
+    void update(
+      pcl::PointCloud<pcl::PointXYZ>::ConstPtr pointCloud)
+    {
+      update(fromPCL(*pointCloud));
+    }
+
+    void update(std::chrono::high_resolution_clock::time_point stamp,
+      pcl::PointCloud<pcl::PointXYZ>::ConstPtr pointCloud, std::string inputPath = "")
+    {
+      update(stamp, fromPCL(*pointCloud), inputPath);
+    }
+
+    std::shared_future<FrameResult> updateAsync(
+      std::chrono::high_resolution_clock::time_point stamp,
+      pcl::PointCloud<pcl::PointXYZ>::ConstPtr pointCloud)
+    {
+      return updateAsync(stamp, fromPCL(*pointCloud));
+    }
+#endif
 
     const std::vector<RigidBody>& rigidBodies() const;
 
+    // Register configurations at runtime; returns the index to be used by
+    // rigid bodies. Existing indices stay valid.
+    size_t addMarkerConfiguration(const MarkerConfiguration& markerConfiguration);
+    size_t addDynamicsConfiguration(const DynamicsConfiguration& dynamicsConfiguration);
+
+    // Adds a rigid body (uninitialized, like those passed to the
+    // constructor) and returns its index. The state of all other bodies is
+    // kept. Throws if a configuration index is out of range.
+    size_t addRigidBody(const RigidBody& rigidBody);
+
+    // Removes the rigid body at the given index; bodies behind it move down
+    // by one. Like the above, blocks while an update is running; pending
+    // asynchronous updates see the change.
+    void removeRigidBody(size_t rigidBodyIdx);
+
+    // Switches a rigid body between position-only and full pose tracking,
+    // effective from the next frame. A promoted body resumes registration
+    // from the orientation it was acquired with; if it turned too far since,
+    // it is lost and re-acquired. Throws if the index is out of range.
+    void setPositionOnly(size_t rigidBodyIdx, bool positionOnly);
+
+    // State of the rigid body at stamp, interpolated from its pose history
+    // or extrapolated up to maxExtrapolation of its dynamics configuration.
+    // Must not run concurrently with adding or removing rigid bodies; other
+    // threads should query rigidBodies()[i].poseHistory() instead.
+    bool poseAt(size_t rigidBodyIdx,
+      std::chrono::high_resolution_clock::time_point stamp,
+      PoseEstimate& pose) const;
+
+    // Checkpoint of the tracking state of all rigid bodies (pose, velocity,
+    // validity, stamps, initialization and motion filter state, and whether
+    // only the position is tracked) as a compact binary blob, e.g., to resume
+    // tracking after a restart of the process or in the middle of a
+    // recording. Host byte order.
+    std::vector<uint8_t> saveState() const;
+
+    // Restores a checkpoint of saveState(). Rigid bodies are matched by
+    // name; bodies missing from the checkpoint keep their state. Bodies whose
+    // last valid pose is older than reinitTimeout at the next frame are
+    // re-acquired around that pose. Returns the number of restored bodies;
+    // throws std::runtime_error if the blob is corrupt or of another version,
+    // or if a body was saved with another marker configuration.
+    size_t restoreState(const std::vector<uint8_t>& state);
+
     void setLogWarningCallback(
       std::function<void(const std::string&)> logWarn);
 
-  private:
-    // Update and init using ICP
-    void updatePose(std::chrono::high_resolution_clock::time_point stamp,
-      const pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers);
+    // Publishes the poses of all rigid bodies at the end of every frame,
+    // e.g., into shared memory for other processes; nullptr disables.
+    void setPosePublisher(std::shared_ptr<PosePublisher> publisher);
+
+    // Called once per frame and rigid body (by index), as soon as the pose
+    // of that body is final: once the candidates of all bodies are known if
+    // none of its candidate markers is wanted by another body, otherwise
+    // after the assignment of its group. Called from the thread running the
+    // update.
+    void setRigidBodyCallback(
+      std::function<void(size_t, const RigidBody&)> callback);
+
+    // Limits how many rigid bodies are (re-)initialized per frame; others
+    // wait for a later frame. Unlimited by default.
+    void setMaxInitializationsPerFrame(size_t maxInitializations);
+
+    // If enabled, the expensive pose search for lost or uninitialized
+    // multi-marker bodies runs on a background thread on a snapshot of the
+    // unclaimed markers. The result is confirmed against a later frame with
+    // a single ICP run, so healthy bodies are never delayed by the search.
+    // Results that arrive too late to be confirmed (older than
+    // reinitTimeout, or than a few frames) are discarded and searched again,
+    // so playback much faster than real time may never acquire bodies this
+    // way; keep it disabled there.
+    void setBackgroundReacquisition(bool enabled);
+
+    // Enables the marker prefilter, see PrefilterConfiguration.
+    void setPrefilterConfiguration(const PrefilterConfiguration& configuration);
+
+    const PrefilterStatistics& prefilterStatistics() const { return m_prefilterStatistics; }
 
-    bool initializePose(
-      pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers);
+    // Number of tracking ICP runs per number of iterations (index), summed
+    // over all rigid bodies and frames since the last reset. Runs of one
+    // body in the same frame are counted as one.
+    const std::vector<size_t>& icpIterationHistogram() const { return m_icpIterationHistogram; }
+    void resetIcpIterationHistogram();
 
-    // Update and init using nearest neighbor
-    void updatePosition(std::chrono::high_resolution_clock::time_point stamp,
-      const pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers);
+    // Number of threads used for per-body and per-seed work (including the
+    // thread calling update()). Defaults to 1, i.e., everything runs inline.
+    void setNumThreads(size_t numThreads);
 
+  private:
+    // Tracks all initialized rigid bodies, each by its own tracking mode.
+    // Conflicts over markers are resolved per group of bodies that compete
+    // for the same markers; lost bodies are acquired afterwards.
+    void updateRigidBodies(std::chrono::high_resolution_clock::time_point stamp,
+      PointCloud::ConstPtr markers);
+
+    // (re-)initializes the given multi-marker rigid bodies using ICP
+    bool initializePose(std::chrono::high_resolution_clock::time_point stamp,
+      PointCloud::ConstPtr markers,
+      const std::vector<size_t>& rigidBodyIdxs);
+
+    // (re-)initializes the given single-marker rigid bodies around their
+    // last known position by assignment to the markers within
+    // maxInitialDeviation() of it
     bool initializePosition(std::chrono::high_resolution_clock::time_point stamp,
-      pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers);
+      PointCloud::ConstPtr markers,
+      const std::vector<size_t>& rigidBodyIdxs);
+
+    void updateLocked(std::chrono::high_resolution_clock::time_point stamp,
+      PointCloud::ConstPtr pointCloud, const std::string& inputPath);
+
+    // finalizes the rigid body for this frame: updates its motion filter and
+    // invokes the rigid body callback, unless already done for this frame
+    void notifyRigidBody(size_t rigidBodyIdx);
 
-    bool initializeHybrid(std::chrono::high_resolution_clock::time_point stamp,
-      pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers);
+    // fuses the pose of this frame (if any) into the motion filter
+    void updateMotionFilter(RigidBody& rigidBody);
 
-    void updateHybrid(std::chrono::high_resolution_clock::time_point stamp,
-      const pcl::PointCloud<pcl::PointXYZ>::ConstPtr markers); 
+    // appends the pose of this frame (if any) to the pose history
+    void updatePoseHistory(RigidBody& rigidBody);
+
+    // gives the rigid body a new, empty pose history
+    void resetPoseHistory(RigidBody& rigidBody);
 
     void logWarn(const std::string& msg);
 
+    // (re-)initializes those rigid bodies whose backoff expired, at most
+    // m_maxInitializationsPerFrame of them
+    void acquire(std::chrono::high_resolution_clock::time_point stamp,
+      PointCloud::ConstPtr markers,
+      const std::vector<size_t>& rigidBodyIdxs);
+
+    // Handles (re-)initialization of a multi-marker body via the background
+    // worker. Returns true if an attempt concluded in this frame.
+    bool acquireInBackground(std::chrono::high_resolution_clock::time_point stamp,
+      PointCloud::ConstPtr markers,
+      size_t rigidBodyIdx);
+
+    // allowed distance of a rigid body from its nominal position during
+    // initialization: a third of the distance between the closest two
+    // initial positions
+    float maxInitialDeviation() const;
+
+    // markers that were not assigned to any rigid body in this frame
+    PointCloud::Ptr unclaimedMarkers(
+      PointCloud::ConstPtr markers,
+      const std::vector<bool>& markerClaimed) const;
+
+    // runs fn(rigidBodyIdx) for all rigid bodies on the task scheduler,
+    // using each body's previous runtime as cost hint
+    void runPerRigidBody(const std::function<void(size_t)>& fn);
+
+    // applies the prefilter (if any) to pointCloud
+    PointCloud::ConstPtr prefilter(
+      std::chrono::high_resolution_clock::time_point stamp,
+      PointCloud::ConstPtr pointCloud);
+
+    // sets the tracking mode of each rigid body from its marker count and
+    // updates m_maxInitialDeviation; call whenever m_rigidBodies changes
+    void updateTrackingMode();
+
+    // drops background search results (and searches in flight); call
+    // whenever rigid body indices change
+    void discardHypotheses();
+
+    struct PoseHypothesis
+    {
+      bool found;
+      Eigen::Affine3f transformation;
+      std::chrono::high_resolution_clock::time_point stamp;
+      // m_frame of the snapshot
+      size_t frame;
+    };
+
   private:
     std::vector<MarkerConfiguration> m_markerConfigurations;
+    // one per marker configuration, built by the constructor
+    std::vector<std::shared_ptr<const MarkerConfigurationDescriptor>> m_markerDescriptors;
     std::vector<DynamicsConfiguration> m_dynamicsConfigurations;
     std::vector<RigidBody> m_rigidBodies;
-    bool m_initialized;
-    int m_init_attempts;
-    bool m_trackPositionOnly;
-    TrackingMode m_trackingMode;
+    size_t m_frame;
+    size_t m_maxInitializationsPerFrame;
+    float m_maxInitialDeviation;
     std::function<void(const std::string&)> m_logWarn;
+    std::mutex m_logWarnMutex;
+    std::unique_ptr<TaskScheduler> m_scheduler;
+    std::function<void(size_t, const RigidBody&)> m_rigidBodyCallback;
+    // one entry per rigid body; not std::vector<bool>, which cannot be
+    // written concurrently
+    std::vector<uint8_t> m_notified;
+    // held while the rigid bodies are updated or changed
+    mutable std::mutex m_updateMutex;
+    std::shared_future<FrameResult> m_lastAsyncUpdate;
+    // input storage of update(MarkerView) for strided buffers, reused across
+    // frames
+    PointCloud::Ptr m_inputCloud;
+    std::vector<uint32_t> m_inputIds;
     std::string m_inputPath;
+    std::unique_ptr<MarkerPrefilter> m_prefilter;
+    PrefilterStatistics m_prefilterStatistics;
+    std::vector<size_t> m_icpIterationHistogram;
+    std::mutex m_hypothesesMutex;
+    // results of the background worker, by rigid body
+    std::map<size_t, PoseHypothesis> m_hypotheses;
+    std::unique_ptr<ReacquisitionWorker> m_reacquisitionWorker;
+    std::shared_ptr<PosePublisher> m_posePublisher;
+    std::unique_ptr<LatestFrameWorker> m_latestFrameWorker;
+    mutable std::mutex m_ingestMutex;
+    IngestStatistics m_ingestStatistics;
 
+    friend ShardedRigidBodyTracker;
   };
 
 } // namespace librigidbodytracker
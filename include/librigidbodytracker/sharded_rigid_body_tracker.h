@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "librigidbodytracker/rigid_body_tracker.h"
+
+namespace librigidbodytracker {
+
+  // Partitioning of the flight volume into a grid of zones in the xy-plane.
+  // Zones on the border extend to infinity, so markers outside of the volume
+  // are still routed to the closest zone.
+  struct ShardConfiguration
+  {
+    Eigen::Vector3f lowerBound;
+    Eigen::Vector3f upperBound;
+    size_t numShardsX;
+    size_t numShardsY;
+    // markers within this distance (m) of a zone boundary are routed
+    // to both neighboring zones
+    float overlap;
+  };
+
+  // Front end that runs one independent RigidBodyTracker per zone; the zones
+  // are updated concurrently on a pool of one worker per zone. A rigid body is owned by the zone that contains its
+  // center and is handed off (including pose and velocity) once it crosses
+  // into another zone.
+  class ShardedRigidBodyTracker
+  {
+  public:
+    ShardedRigidBodyTracker(
+      const ShardConfiguration& shardConfiguration,
+      const std::vector<DynamicsConfiguration>& dynamicsConfigurations,
+      const std::vector<MarkerConfiguration>& markerConfigurations,
+      const std::vector<RigidBody>& rigidBodies);
+
+    ~ShardedRigidBodyTracker();
+
+    void update(
+      PointCloud::Ptr pointCloud);
+
+    void update(std::chrono::high_resolution_clock::time_point stamp,
+      PointCloud::ConstPtr pointCloud);
+
+#ifdef LIBRIGIDBODYTRACKER_WITH_PCL
+    void update(std::chrono::high_resolution_clock::time_point stamp,
+      pcl::PointCloud<pcl::PointXYZ>::ConstPtr pointCloud)
+    {
+      update(stamp, fromPCL(*pointCloud));
+    }
+#endif
+
+    // rigid bodies in the order they were passed to the constructor
+    const std::vector<RigidBody>& rigidBodies() const;
+
+    size_t numShards() const { return m_shards.size(); }
+
+    void setLogWarningCallback(
+      std::function<void(const std::string&)> logWarn);
+
+    // publishes the merged poses of all shards at the end of every frame
+    void setPosePublisher(std::shared_ptr<PosePublisher> publisher);
+
+  private:
+    struct Shard
+    {
+      std::unique_ptr<RigidBodyTracker> tracker;
+      // maps local rigid body index -> index in m_rigidBodies
+      std::vector<size_t> rigidBodyIds;
+      PointCloud::Ptr markers;
+      // runtime (s) of the last update, used to balance the workers
+      double updateCost;
+    };
+
+    size_t cellX(float x) const;
+    size_t cellY(float y) const;
+    size_t shardIndex(const Eigen::Vector3f& position) const;
+
+    void routeMarkers(
+      PointCloud::ConstPtr pointCloud);
+
+    void handOff();
+
+  private:
+    ShardConfiguration m_shardConfiguration;
+    std::vector<Shard> m_shards;
+    std::unique_ptr<TaskScheduler> m_scheduler;
+    std::vector<RigidBody> m_rigidBodies;
+    std::function<void(const std::string&)> m_logWarn;
+    std::shared_ptr<PosePublisher> m_posePublisher;
+    std::mutex m_logWarnMutex;
+  };
+
+} // namespace librigidbodytracker
@@ -0,0 +1,158 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "librigidbodytracker/marker_view.h"
+
+namespace librigidbodytracker {
+
+  class RigidBodyTracker;
+
+  // Wire format of the UDP marker stream. A frame is split into fragments of
+  // consecutive markers, one fragment per datagram: a MarkerDatagramHeader
+  // followed by markersInFragment x, y, z float triplets (m). Host byte
+  // order; meant for a local network of identical machines.
+  static const uint16_t MarkerDatagramVersion = 1;
+
+  struct MarkerDatagramHeader
+  {
+    // "LRBU"
+    char magic[4];
+    uint16_t version;
+    uint16_t fragmentIndex;
+    uint16_t fragmentCount;
+    uint16_t markersInFragment;
+    // increases by one per frame
+    uint32_t frameNumber;
+    // ns; passed to the tracker as frame stamp
+    int64_t stamp;
+    // markers of the whole frame, and index of this fragment's first one
+    uint32_t numMarkers;
+    uint32_t firstMarker;
+  };
+
+  static_assert(sizeof(MarkerDatagramHeader) == 32, "unexpected datagram layout");
+
+  // fragments per frame are limited by the reassembly bookkeeping
+  static const size_t MaxFragmentsPerFrame = 64;
+
+  /*! \brief Sends marker frames as datagrams of the UDP marker stream
+
+  Fragments larger frames so that datagrams stay within maxDatagramSize
+  (default: Ethernet MTU) and sends all fragments of a frame with one
+  system call. Throws std::runtime_error if the socket cannot be set up.
+  */
+  class UdpMarkerSender
+  {
+  public:
+    UdpMarkerSender(const std::string& host, uint16_t port, size_t maxDatagramSize = 1472);
+    ~UdpMarkerSender();
+
+    UdpMarkerSender(const UdpMarkerSender&) = delete;
+    UdpMarkerSender& operator=(const UdpMarkerSender&) = delete;
+
+    // false if the frame has too many markers or could not be sent
+    bool send(std::chrono::high_resolution_clock::time_point stamp, const MarkerView& markers);
+
+  private:
+    int m_socket;
+    size_t m_markersPerDatagram;
+    uint32_t m_frameNumber;
+    std::vector<uint8_t> m_buffer;
+  };
+
+  struct UdpReceiverStatistics
+  {
+    size_t datagrams = 0;
+    // wrong magic, version, or inconsistent sizes, and fragments of frames
+    // with more than maxMarkers markers
+    size_t malformedDatagrams = 0;
+    // datagrams that arrived after a datagram of a newer frame
+    size_t reorderedDatagrams = 0;
+    // datagrams of frames that were already delivered or given up
+    size_t lateDatagrams = 0;
+    size_t frames = 0;
+    // frame numbers never delivered: lost datagrams, or incomplete frames
+    // overtaken by newer complete ones
+    size_t droppedFrames = 0;
+    // sender restarts detected; frame numbering starts over after each
+    size_t resyncs = 0;
+  };
+
+  /*! \brief Receives the UDP marker stream and reassembles frames
+
+  Datagrams are received in batches (recvmmsg) into preallocated buffers,
+  and fragments are copied straight into preallocated frame buffers; no
+  memory is allocated while receiving. Complete frames are delivered in
+  frame number order as soon as their last fragment arrives; older
+  incomplete frames are given up at that point. A sender restart, i.e.,
+  frame numbers going far back, or back with newer stamps, is followed
+  instead of treating the new frames as late. Linux only.
+  */
+  class UdpMarkerReceiver
+  {
+  public:
+    // frames with more than maxMarkers markers are dropped; batchSize is the
+    // number of datagrams fetched per system call
+    UdpMarkerReceiver(uint16_t port, size_t maxMarkers,
+      const std::string& bindAddress = "0.0.0.0", size_t batchSize = 32);
+    ~UdpMarkerReceiver();
+
+    UdpMarkerReceiver(const UdpMarkerReceiver&) = delete;
+    UdpMarkerReceiver& operator=(const UdpMarkerReceiver&) = delete;
+
+    typedef std::function<void(std::chrono::high_resolution_clock::time_point, const MarkerView&)> FrameCallback;
+
+    // Waits up to timeout for datagrams, then drains the socket batch by
+    // batch and calls onFrame for every completed frame. Returns the number
+    // of frames delivered.
+    size_t receive(std::chrono::milliseconds timeout, const FrameCallback& onFrame);
+
+    // same as above, updating the tracker with every completed frame
+    size_t receive(std::chrono::milliseconds timeout, RigidBodyTracker& tracker);
+
+    const UdpReceiverStatistics& statistics() const { return m_statistics; }
+
+  private:
+    struct Assembly
+    {
+      bool used;
+      uint32_t frameNumber;
+      int64_t stamp;
+      uint32_t numMarkers;
+      uint16_t fragmentCount;
+      uint64_t receivedFragments;
+      std::vector<float> markers;
+    };
+
+    // copies the fragment into its frame, delivering the frame once complete
+    void handleDatagram(const uint8_t* data, size_t size, size_t& delivered, const FrameCallback& onFrame);
+    // frame buffer of the datagram's frame; gives up the oldest incomplete
+    // frame if all are in use
+    Assembly& assemblyFor(const MarkerDatagramHeader& header);
+    void deliver(Assembly& assembly, size_t& delivered, const FrameCallback& onFrame);
+    // forgets the frame numbering after a sender restart
+    void resync();
+
+  private:
+    int m_socket;
+    size_t m_maxMarkers;
+    // receive buffers and recvmmsg bookkeeping, allocated once
+    struct Batch;
+    std::unique_ptr<Batch> m_batch;
+    std::vector<Assembly> m_assemblies;
+    bool m_anyDelivered;
+    uint32_t m_lastDelivered;
+    int64_t m_lastDeliveredStamp;
+    size_t m_consecutiveLate;
+    bool m_anyReceived;
+    uint32_t m_newestReceived;
+    UdpReceiverStatistics m_statistics;
+  };
+
+} // namespace librigidbodytracker
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+
+namespace librigidbodytracker {
+
+// Appends values in host byte order; used for caches and checkpoints that
+// are read back on the same machine.
+class BinaryWriter
+{
+public:
+  template <typename T>
+  void write(const T& value)
+  {
+    m_buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  void writeString(const std::string& s)
+  {
+    write<uint32_t>(s.size());
+    m_buffer.append(s);
+  }
+
+  const std::string& buffer() const { return m_buffer; }
+
+private:
+  std::string m_buffer;
+};
+
+// all reads are bounds checked, so truncated input fails cleanly
+class BinaryReader
+{
+public:
+  BinaryReader(const void* data, size_t size)
+    : m_data(static_cast<const char*>(data))
+    , m_size(size)
+    , m_pos(0)
+  {
+  }
+
+  template <typename T>
+  bool read(T& value)
+  {
+    if (m_size - m_pos < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&value, m_data + m_pos, sizeof(T));
+    m_pos += sizeof(T);
+    return true;
+  }
+
+  bool readString(std::string& s)
+  {
+    uint32_t size;
+    if (!read(size) || m_size - m_pos < size) {
+      return false;
+    }
+    s.assign(m_data + m_pos, size);
+    m_pos += size;
+    return true;
+  }
+
+  size_t remaining() const { return m_size - m_pos; }
+  bool atEnd() const { return m_pos == m_size; }
+
+private:
+  const char* m_data;
+  size_t m_size;
+  size_t m_pos;
+};
+
+} // namespace librigidbodytracker
@@ -0,0 +1,343 @@
+#include "librigidbodytracker/configuration.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include "binary_io.hpp"
+
+namespace librigidbodytracker {
+
+namespace {
+
+  // "LRBTCFG" followed by a zero byte
+  const char CacheMagic[8] = {'L', 'R', 'B', 'T', 'C', 'F', 'G', 0};
+  // bump whenever the layout below changes
+  const uint32_t CacheVersion = 4;
+
+  void writeDynamics(BinaryWriter& w, const DynamicsConfiguration& conf)
+  {
+    w.write<double>(conf.maxXVelocity);
+    w.write<double>(conf.maxYVelocity);
+    w.write<double>(conf.maxZVelocity);
+    w.write<double>(conf.maxPitchRate);
+    w.write<double>(conf.maxRollRate);
+    w.write<double>(conf.maxYawRate);
+    w.write<double>(conf.maxRoll);
+    w.write<double>(conf.maxPitch);
+    w.write<double>(conf.maxFitnessScore);
+    w.write<double>(conf.maxSpreadDeviation);
+    w.write<double>(conf.reinitTimeout);
+    w.write<uint64_t>(conf.maxMarkerCandidates);
+    w.write<int32_t>(conf.icpMaxIterations);
+    w.write<double>(conf.icpTransformationEpsilon);
+    w.write<double>(conf.icpFitnessEpsilon);
+    w.write<uint8_t>(conf.icpAdaptiveIterations);
+    w.write<int32_t>(conf.icpMinIterations);
+    w.write<uint8_t>(conf.useMotionFilter);
+    w.write<double>(conf.motionProcessNoise);
+    w.write<double>(conf.measurementNoise);
+    w.write<double>(conf.gateSigma);
+    w.write<uint64_t>(conf.poseHistorySize);
+    w.write<double>(conf.maxExtrapolation);
+  }
+
+  bool readDynamics(BinaryReader& r, DynamicsConfiguration& conf)
+  {
+    uint64_t maxMarkerCandidates;
+    int32_t icpMaxIterations;
+    int32_t icpMinIterations;
+    uint8_t icpAdaptiveIterations;
+    uint8_t useMotionFilter;
+    uint64_t poseHistorySize;
+    bool ok = r.read(conf.maxXVelocity)
+      && r.read(conf.maxYVelocity)
+      && r.read(conf.maxZVelocity)
+      && r.read(conf.maxPitchRate)
+      && r.read(conf.maxRollRate)
+      && r.read(conf.maxYawRate)
+      && r.read(conf.maxRoll)
+      && r.read(conf.maxPitch)
+      && r.read(conf.maxFitnessScore)
+      && r.read(conf.maxSpreadDeviation)
+      && r.read(conf.reinitTimeout)
+      && r.read(maxMarkerCandidates)
+      && r.read(icpMaxIterations)
+      && r.read(conf.icpTransformationEpsilon)
+      && r.read(conf.icpFitnessEpsilon)
+      && r.read(icpAdaptiveIterations)
+      && r.read(icpMinIterations)
+      && r.read(useMotionFilter)
+      && r.read(conf.motionProcessNoise)
+      && r.read(conf.measurementNoise)
+      && r.read(conf.gateSigma)
+      && r.read(poseHistorySize)
+      && r.read(conf.maxExtrapolation);
+    conf.maxMarkerCandidates = maxMarkerCandidates;
+    conf.icpMaxIterations = icpMaxIterations;
+    conf.icpMinIterations = icpMinIterations;
+    conf.icpAdaptiveIterations = icpAdaptiveIterations;
+    conf.useMotionFilter = useMotionFilter;
+    conf.poseHistorySize = poseHistorySize;
+    return ok;
+  }
+
+  void writeVector(BinaryWriter& w, const Eigen::Vector3f& v)
+  {
+    w.write<float>(v.x());
+    w.write<float>(v.y());
+    w.write<float>(v.z());
+  }
+
+  bool readVector(BinaryReader& r, Eigen::Vector3f& v)
+  {
+    return r.read(v.x()) && r.read(v.y()) && r.read(v.z());
+  }
+
+} // anonymous namespace
+
+void validateConfiguration(const TrackerConfiguration& configuration)
+{
+  for (size_t i = 0; i < configuration.markerConfigurations.size(); ++i) {
+    const MarkerConfiguration& markers = configuration.markerConfigurations[i];
+    if (!markers || markers->empty()) {
+      std::stringstream sstr;
+      sstr << "marker configuration " << i << " has no markers";
+      throw std::runtime_error(sstr.str());
+    }
+  }
+
+  for (size_t i = 0; i < configuration.dynamicsConfigurations.size(); ++i) {
+    const DynamicsConfiguration& conf = configuration.dynamicsConfigurations[i];
+    std::stringstream sstr;
+    sstr << "dynamics configuration " << i << ": ";
+    if (conf.maxXVelocity < 0 || conf.maxYVelocity < 0 || conf.maxZVelocity < 0
+        || conf.maxRollRate < 0 || conf.maxPitchRate < 0 || conf.maxYawRate < 0) {
+      sstr << "velocity limits must not be negative";
+      throw std::runtime_error(sstr.str());
+    }
+    if (conf.maxFitnessScore <= 0) {
+      sstr << "max_fitness_score must be positive";
+      throw std::runtime_error(sstr.str());
+    }
+    if (conf.maxSpreadDeviation <= 0) {
+      sstr << "max_spread_deviation must be positive";
+      throw std::runtime_error(sstr.str());
+    }
+    if (conf.icpMaxIterations < 1) {
+      sstr << "max_iterations must be positive";
+      throw std::runtime_error(sstr.str());
+    }
+    if (conf.icpAdaptiveIterations
+        && (conf.icpMinIterations < 1 || conf.icpMinIterations > conf.icpMaxIterations)) {
+      sstr << "need 1 <= min_iterations <= max_iterations";
+      throw std::runtime_error(sstr.str());
+    }
+    if (conf.useMotionFilter && (conf.motionProcessNoise <= 0 || conf.measurementNoise <= 0)) {
+      sstr << "motion filter noise must be positive";
+      throw std::runtime_error(sstr.str());
+    }
+  }
+
+  std::set<std::string> names;
+  for (const RigidBody& rigidBody : configuration.rigidBodies) {
+    std::stringstream sstr;
+    sstr << "rigid body " << rigidBody.name() << ": ";
+    if (!names.insert(rigidBody.name()).second) {
+      sstr << "duplicate name";
+      throw std::runtime_error(sstr.str());
+    }
+    if (rigidBody.markerConfigurationIdx() >= configuration.markerConfigurations.size()) {
+      sstr << "unknown marker configuration";
+      throw std::runtime_error(sstr.str());
+    }
+    if (rigidBody.dynamicsConfigurationIdx() >= configuration.dynamicsConfigurations.size()) {
+      sstr << "unknown dynamics configuration";
+      throw std::runtime_error(sstr.str());
+    }
+  }
+}
+
+void saveConfigurationCache(const TrackerConfiguration& configuration,
+  const std::string& cacheFile, uint64_t sourceHash)
+{
+  BinaryWriter w;
+  for (char c : CacheMagic) {
+    w.write(c);
+  }
+  w.write(CacheVersion);
+  w.write(sourceHash);
+
+  w.write<uint32_t>(configuration.dynamicsConfigurations.size());
+  for (const auto& conf : configuration.dynamicsConfigurations) {
+    writeDynamics(w, conf);
+  }
+
+  w.write<uint32_t>(configuration.markerConfigurations.size());
+  for (const auto& markers : configuration.markerConfigurations) {
+    w.write<uint32_t>(markers->size());
+    for (const MarkerCloud::PointType& p : *markers) {
+      w.write(p.x);
+      w.write(p.y);
+      w.write(p.z);
+    }
+  }
+
+  w.write<uint32_t>(configuration.rigidBodies.size());
+  for (const RigidBody& rigidBody : configuration.rigidBodies) {
+    w.writeString(rigidBody.name());
+    w.write<uint32_t>(rigidBody.markerConfigurationIdx());
+    w.write<uint32_t>(rigidBody.dynamicsConfigurationIdx());
+    const Eigen::Matrix4f& m = rigidBody.initialTransformation().matrix();
+    for (int i = 0; i < 16; ++i) {
+      w.write<float>(m.data()[i]);
+    }
+    w.write<uint8_t>(rigidBody.positionOnly());
+  }
+
+  const PrefilterConfiguration& prefilter = configuration.prefilter;
+  w.write<uint8_t>(configuration.usePrefilter);
+  w.write<uint8_t>(prefilter.useBoundingBox);
+  writeVector(w, prefilter.lowerBound);
+  writeVector(w, prefilter.upperBound);
+  w.write<float>(prefilter.gatingDistance);
+  w.write<uint64_t>(prefilter.minPersistence);
+  w.write<float>(prefilter.persistenceRadius);
+
+  // write to a temporary file first, so readers never see a partial cache
+  std::string tmpFile = cacheFile + ".tmp";
+  {
+    std::ofstream file(tmpFile, std::ios::binary | std::ios::out | std::ios::trunc);
+    file.write(w.buffer().data(), w.buffer().size());
+    if (!file) {
+      throw std::runtime_error("cannot write configuration cache " + tmpFile);
+    }
+  }
+  if (std::rename(tmpFile.c_str(), cacheFile.c_str()) != 0) {
+    std::remove(tmpFile.c_str());
+    throw std::runtime_error("cannot write configuration cache " + cacheFile);
+  }
+}
+
+bool loadConfigurationCache(const std::string& cacheFile,
+  TrackerConfiguration& configuration, uint64_t sourceHash)
+{
+  std::ifstream file(cacheFile, std::ios::binary | std::ios::in | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  if (!file.read(buffer.data(), buffer.size())) {
+    return false;
+  }
+
+  BinaryReader r(buffer.data(), buffer.size());
+  char magic[sizeof(CacheMagic)];
+  for (char& c : magic) {
+    if (!r.read(c)) {
+      return false;
+    }
+  }
+  uint32_t version;
+  uint64_t storedHash;
+  if (std::memcmp(magic, CacheMagic, sizeof(CacheMagic)) != 0
+      || !r.read(version) || version != CacheVersion
+      || !r.read(storedHash) || (sourceHash != 0 && storedHash != sourceHash)) {
+    return false;
+  }
+
+  TrackerConfiguration result;
+  uint32_t count;
+  if (!r.read(count) || r.remaining() < count) {
+    return false;
+  }
+  result.dynamicsConfigurations.resize(count);
+  for (auto& conf : result.dynamicsConfigurations) {
+    if (!readDynamics(r, conf)) {
+      return false;
+    }
+  }
+
+  if (!r.read(count)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t numMarkers;
+    if (!r.read(numMarkers) || r.remaining() / (3 * sizeof(float)) < numMarkers) {
+      return false;
+    }
+    MarkerConfiguration markers(new MarkerCloud);
+    markers->resize(numMarkers);
+    for (MarkerCloud::PointType& p : *markers) {
+      if (!r.read(p.x) || !r.read(p.y) || !r.read(p.z)) {
+        return false;
+      }
+    }
+    result.markerConfigurations.push_back(markers);
+  }
+
+  if (!r.read(count) || r.remaining() < count) {
+    return false;
+  }
+  result.rigidBodies.reserve(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    std::string name;
+    uint32_t markerIdx;
+    uint32_t dynamicsIdx;
+    Eigen::Affine3f initialTransformation;
+    if (!r.readString(name) || !r.read(markerIdx) || !r.read(dynamicsIdx)) {
+      return false;
+    }
+    for (int j = 0; j < 16; ++j) {
+      if (!r.read(initialTransformation.matrix().data()[j])) {
+        return false;
+      }
+    }
+    uint8_t positionOnly;
+    if (!r.read(positionOnly)) {
+      return false;
+    }
+    result.rigidBodies.emplace_back(markerIdx, dynamicsIdx, initialTransformation, name);
+    result.rigidBodies.back().setPositionOnly(positionOnly);
+  }
+
+  PrefilterConfiguration& prefilter = result.prefilter;
+  uint8_t usePrefilter;
+  uint8_t useBoundingBox;
+  uint64_t minPersistence;
+  if (!r.read(usePrefilter) || !r.read(useBoundingBox)
+      || !readVector(r, prefilter.lowerBound) || !readVector(r, prefilter.upperBound)
+      || !r.read(prefilter.gatingDistance) || !r.read(minPersistence)
+      || !r.read(prefilter.persistenceRadius) || !r.atEnd()) {
+    return false;
+  }
+  result.usePrefilter = usePrefilter;
+  prefilter.useBoundingBox = useBoundingBox;
+  prefilter.minPersistence = minPersistence;
+
+  // the cache was validated when written; this only guards against
+  // corrupt files that happen to parse
+  try {
+    validateConfiguration(result);
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+  configuration = std::move(result);
+  return true;
+}
+
+uint64_t configurationSourceHash(const std::string& source)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : source) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+} // namespace librigidbodytracker
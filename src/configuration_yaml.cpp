@@ -0,0 +1,216 @@
+#include "librigidbodytracker/configuration.h"
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "yaml-cpp/yaml.h"
+
+namespace librigidbodytracker {
+
+namespace {
+
+  [[noreturn]] void fail(const std::string& context, const std::string& msg)
+  {
+    throw std::runtime_error(context + ": " + msg);
+  }
+
+  YAML::Node requireMap(const YAML::Node& node, const std::string& context)
+  {
+    if (!node || !node.IsMap()) {
+      fail(context, "expected a map");
+    }
+    return node;
+  }
+
+  template <typename T>
+  T required(const YAML::Node& parent, const std::string& key, const std::string& context)
+  {
+    const YAML::Node node = parent[key];
+    if (!node) {
+      fail(context, "missing " + key);
+    }
+    try {
+      return node.as<T>();
+    } catch (const YAML::Exception&) {
+      fail(context, "invalid " + key);
+    }
+  }
+
+  template <typename T>
+  void optional(const YAML::Node& parent, const std::string& key, const std::string& context, T& value)
+  {
+    if (parent[key]) {
+      value = required<T>(parent, key, context);
+    }
+  }
+
+  Eigen::Vector3f asVec(const YAML::Node& node, const std::string& context)
+  {
+    if (!node || !node.IsSequence() || node.size() != 3) {
+      fail(context, "expected a sequence of three numbers");
+    }
+    try {
+      return Eigen::Vector3f(
+        node[0].as<float>(), node[1].as<float>(), node[2].as<float>());
+    } catch (const YAML::Exception&) {
+      fail(context, "expected a sequence of three numbers");
+    }
+  }
+
+  DynamicsConfiguration parseDynamics(const YAML::Node& val, const std::string& context)
+  {
+    requireMap(val, context);
+    DynamicsConfiguration conf;
+    Eigen::Vector3f maxVel = asVec(val["max_velocity"], context + "/max_velocity");
+    conf.maxXVelocity = maxVel(0);
+    conf.maxYVelocity = maxVel(1);
+    conf.maxZVelocity = maxVel(2);
+    Eigen::Vector3f maxAngularVel = asVec(val["max_angular_velocity"], context + "/max_angular_velocity");
+    conf.maxPitchRate = maxAngularVel(0);
+    conf.maxRollRate = maxAngularVel(1);
+    conf.maxYawRate = maxAngularVel(2);
+    conf.maxRoll = required<float>(val, "max_roll", context);
+    conf.maxPitch = required<float>(val, "max_pitch", context);
+    conf.maxFitnessScore = required<float>(val, "max_fitness_score", context);
+    optional(val, "max_spread_deviation", context, conf.maxSpreadDeviation);
+    optional(val, "reinit_timeout", context, conf.reinitTimeout);
+    optional(val, "max_marker_candidates", context, conf.maxMarkerCandidates);
+    optional(val, "pose_history_size", context, conf.poseHistorySize);
+    optional(val, "max_extrapolation", context, conf.maxExtrapolation);
+
+    const YAML::Node filter = val["motion_filter"];
+    if (filter) {
+      std::string filterContext = context + "/motion_filter";
+      requireMap(filter, filterContext);
+      conf.useMotionFilter = true;
+      optional(filter, "process_noise", filterContext, conf.motionProcessNoise);
+      optional(filter, "measurement_noise", filterContext, conf.measurementNoise);
+      optional(filter, "gate_sigma", filterContext, conf.gateSigma);
+    }
+
+    const YAML::Node icp = val["icp"];
+    if (icp) {
+      std::string icpContext = context + "/icp";
+      requireMap(icp, icpContext);
+      optional(icp, "max_iterations", icpContext, conf.icpMaxIterations);
+      optional(icp, "min_iterations", icpContext, conf.icpMinIterations);
+      optional(icp, "transformation_epsilon", icpContext, conf.icpTransformationEpsilon);
+      optional(icp, "fitness_epsilon", icpContext, conf.icpFitnessEpsilon);
+      optional(icp, "adaptive_iterations", icpContext, conf.icpAdaptiveIterations);
+    }
+    return conf;
+  }
+
+  TrackerConfiguration parseConfiguration(const YAML::Node& cfg)
+  {
+    TrackerConfiguration result;
+
+    std::map<std::string, size_t> dynamicsNameToIndex;
+    for (const auto& dyn : requireMap(cfg["dynamics_configurations"], "dynamics_configurations")) {
+      std::string name = dyn.first.as<std::string>();
+      dynamicsNameToIndex[name] = result.dynamicsConfigurations.size();
+      result.dynamicsConfigurations.push_back(
+        parseDynamics(dyn.second, "dynamics_configurations/" + name));
+    }
+
+    std::map<std::string, size_t> markerNameToIndex;
+    for (const auto& config : requireMap(cfg["marker_configurations"], "marker_configurations")) {
+      std::string name = config.first.as<std::string>();
+      std::string context = "marker_configurations/" + name;
+      const YAML::Node val = requireMap(config.second, context);
+      Eigen::Vector3f offset = asVec(val["offset"], context + "/offset");
+      MarkerConfiguration markers(new MarkerCloud);
+      for (const auto& point : requireMap(val["points"], context + "/points")) {
+        Eigen::Vector3f pt = asVec(point.second, context + "/points") + offset;
+        markers->push_back(MarkerCloud::PointType(pt.x(), pt.y(), pt.z()));
+      }
+      markerNameToIndex[name] = result.markerConfigurations.size();
+      result.markerConfigurations.push_back(markers);
+    }
+
+    for (const auto& rb : requireMap(cfg["rigid_bodies"], "rigid_bodies")) {
+      std::string name = rb.first.as<std::string>();
+      std::string context = "rigid_bodies/" + name;
+      const YAML::Node val = requireMap(rb.second, context);
+      auto marker = markerNameToIndex.find(required<std::string>(val, "marker", context));
+      if (marker == markerNameToIndex.end()) {
+        fail(context, "unknown marker configuration");
+      }
+      auto dynamics = dynamicsNameToIndex.find(required<std::string>(val, "dynamics", context));
+      if (dynamics == dynamicsNameToIndex.end()) {
+        fail(context, "unknown dynamics configuration");
+      }
+      Eigen::Affine3f xf(Eigen::Translation3f(
+        asVec(val["initial_position"], context + "/initial_position")));
+      result.rigidBodies.emplace_back(marker->second, dynamics->second, xf, name);
+      bool positionOnly = false;
+      optional(val, "position_only", context, positionOnly);
+      result.rigidBodies.back().setPositionOnly(positionOnly);
+    }
+
+    const YAML::Node prefilter = cfg["prefilter"];
+    if (prefilter) {
+      requireMap(prefilter, "prefilter");
+      PrefilterConfiguration& conf = result.prefilter;
+      result.usePrefilter = true;
+      if (prefilter["lower_bound"] && prefilter["upper_bound"]) {
+        conf.useBoundingBox = true;
+        conf.lowerBound = asVec(prefilter["lower_bound"], "prefilter/lower_bound");
+        conf.upperBound = asVec(prefilter["upper_bound"], "prefilter/upper_bound");
+      }
+      optional(prefilter, "gating_distance", "prefilter", conf.gatingDistance);
+      optional(prefilter, "min_persistence", "prefilter", conf.minPersistence);
+      optional(prefilter, "persistence_radius", "prefilter", conf.persistenceRadius);
+    }
+
+    validateConfiguration(result);
+    return result;
+  }
+
+  std::string readFile(const std::string& path)
+  {
+    std::ifstream file(path, std::ios::binary | std::ios::in);
+    if (!file) {
+      throw std::runtime_error("cannot open configuration " + path);
+    }
+    std::stringstream sstr;
+    sstr << file.rdbuf();
+    return sstr.str();
+  }
+
+  TrackerConfiguration parseSource(const std::string& source, const std::string& path)
+  {
+    YAML::Node cfg;
+    try {
+      cfg = YAML::Load(source);
+    } catch (const YAML::Exception& e) {
+      throw std::runtime_error(path + ": " + e.what());
+    }
+    return parseConfiguration(cfg);
+  }
+
+} // anonymous namespace
+
+TrackerConfiguration loadConfiguration(const std::string& yamlFile)
+{
+  return parseSource(readFile(yamlFile), yamlFile);
+}
+
+TrackerConfiguration loadConfiguration(const std::string& yamlFile,
+  const std::string& cacheFile)
+{
+  // reading the source is cheap compared to parsing it
+  std::string source = readFile(yamlFile);
+  uint64_t hash = configurationSourceHash(source);
+  TrackerConfiguration result;
+  if (loadConfigurationCache(cacheFile, result, hash)) {
+    return result;
+  }
+  result = parseSource(source, yamlFile);
+  saveConfigurationCache(result, cacheFile, hash);
+  return result;
+}
+
+} // namespace librigidbodytracker
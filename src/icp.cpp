@@ -0,0 +1,134 @@
+#include "icp.hpp"
+
+#include <cmath>
+#include <limits>
+
+#include <Eigen/Geometry>
+
+namespace librigidbodytracker {
+
+static PointXYZ transformPoint(const Eigen::Matrix4f& t, const PointXYZ& p)
+{
+  Eigen::Vector3f q = t.topLeftCorner<3, 3>() * Eigen::Vector3f(p.x, p.y, p.z) + t.topRightCorner<3, 1>();
+  return PointXYZ(q.x(), q.y(), q.z());
+}
+
+IterativeClosestPoint::IterativeClosestPoint()
+  : m_source()
+  , m_target()
+  , m_tree()
+  , m_treeFromUser(false)
+  , m_maxIterations(10)
+  , m_transformationEpsilon(0)
+  , m_fitnessEpsilon(-std::numeric_limits<double>::max())
+  , m_maxCorrespondenceDistance(std::sqrt(std::numeric_limits<double>::max()))
+  , m_converged(false)
+  , m_settled(false)
+  , m_iterations(0)
+  , m_finalTransformation(Eigen::Matrix4f::Identity())
+  , m_aligned()
+  , m_correspondences()
+  , m_sqrResiduals()
+  , m_fitnessScore(std::numeric_limits<double>::max())
+{
+}
+
+void IterativeClosestPoint::setInputTarget(PointCloud::ConstPtr target)
+{
+  m_target = target;
+  if (!m_treeFromUser) {
+    m_tree.reset();
+  }
+}
+
+void IterativeClosestPoint::setSearchMethodTarget(KdTree::Ptr tree, bool forceNoRecompute)
+{
+  m_tree = tree;
+  m_treeFromUser = forceNoRecompute;
+}
+
+void IterativeClosestPoint::align(PointCloud& output, const Eigen::Matrix4f& guess)
+{
+  m_converged = false;
+  m_settled = false;
+  m_iterations = 0;
+  m_finalTransformation = guess;
+
+  if (!m_tree) {
+    m_tree.reset(new KdTree);
+    m_tree->setInputCloud(m_target);
+  }
+
+  m_aligned.resize(m_source->size());
+  for (size_t i = 0; i < m_source->size(); ++i) {
+    m_aligned[i] = transformPoint(guess, (*m_source)[i]);
+  }
+  m_correspondences.assign(m_aligned.size(), -1);
+
+  double const maxSqrDist = m_maxCorrespondenceDistance * m_maxCorrespondenceDistance;
+  double previousMse = std::numeric_limits<double>::max();
+  std::vector<int> nnIdx(1);
+  std::vector<float> nnSqrDist(1);
+  Eigen::Matrix3Xf src(3, m_aligned.size());
+  Eigen::Matrix3Xf tgt(3, m_aligned.size());
+  while (!m_converged) {
+    size_t numCorrespondences = 0;
+    double sumSqrDist = 0;
+    for (size_t i = 0; i < m_aligned.size(); ++i) {
+      const PointXYZ& p = m_aligned[i];
+      if (m_tree->nearestKSearch(p, 1, nnIdx, nnSqrDist) != 1) {
+        continue;
+      }
+      m_correspondences[i] = nnIdx[0];
+      if (nnSqrDist[0] <= maxSqrDist) {
+        const PointXYZ& q = (*m_target)[nnIdx[0]];
+        src.col(numCorrespondences) = Eigen::Vector3f(p.x, p.y, p.z);
+        tgt.col(numCorrespondences) = Eigen::Vector3f(q.x, q.y, q.z);
+        sumSqrDist += nnSqrDist[0];
+        ++numCorrespondences;
+      }
+    }
+    if (numCorrespondences < 3) {
+      break;
+    }
+
+    Eigen::Matrix4f delta = Eigen::umeyama(
+      src.leftCols(numCorrespondences), tgt.leftCols(numCorrespondences), false);
+    for (PointXYZ& p : m_aligned) {
+      p = transformPoint(delta, p);
+    }
+    m_finalTransformation = delta * m_finalTransformation;
+    ++m_iterations;
+
+    double const mse = sumSqrDist / numCorrespondences;
+    double const cosAngle = 0.5 * (delta.topLeftCorner<3, 3>().trace() - 1);
+    double const translationSqr = delta.topRightCorner<3, 1>().squaredNorm();
+    m_settled = (cosAngle >= 1 - m_transformationEpsilon && translationSqr <= m_transformationEpsilon)
+        || std::fabs(mse - previousMse) < 1e-12
+        || std::fabs(mse - previousMse) / previousMse < m_fitnessEpsilon;
+    if (m_settled || m_iterations >= m_maxIterations) {
+      m_converged = true;
+    }
+    previousMse = mse;
+  }
+
+  // the last iteration's nearest neighbors, at the final transformation
+  m_sqrResiduals.assign(m_aligned.size(), std::numeric_limits<float>::max());
+  double sum = 0;
+  size_t count = 0;
+  for (size_t i = 0; i < m_aligned.size(); ++i) {
+    if (m_correspondences[i] < 0) {
+      continue;
+    }
+    const PointXYZ& p = m_aligned[i];
+    const PointXYZ& q = (*m_target)[m_correspondences[i]];
+    m_sqrResiduals[i] = Eigen::Vector3f(p.x - q.x, p.y - q.y, p.z - q.z).squaredNorm();
+    sum += m_sqrResiduals[i];
+    ++count;
+  }
+  m_fitnessScore = count > 0 ? sum / count : std::numeric_limits<double>::max();
+
+  output = m_aligned;
+}
+
+} // namespace librigidbodytracker
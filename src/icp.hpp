@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "librigidbodytracker/point_cloud.h"
+#include "kdtree.hpp"
+
+namespace librigidbodytracker {
+
+/*! \brief Point-to-point ICP
+
+Follows the semantics of pcl::IterativeClosestPoint with SVD transformation
+estimation, so results match the former PCL-based implementation:
+- a correspondence pairs each transformed source point with its nearest
+  target point, if closer than the max correspondence distance,
+- at least 3 correspondences are needed, otherwise ICP did not converge,
+- it converges once the iteration limit is reached, the transformation
+  increment is below the transformation epsilon, or the mean squared
+  correspondence distance stops changing (absolutely, or relative to the
+  euclidean fitness epsilon), and
+- the fitness score is the mean squared nearest neighbor distance of all
+  aligned source points.
+The nearest neighbors are those of the last iteration, with their distances
+updated to the final transformation, so no search runs after alignment.
+*/
+class IterativeClosestPoint
+{
+public:
+  IterativeClosestPoint();
+
+  void setMaximumIterations(int maxIterations) { m_maxIterations = maxIterations; }
+  void setTransformationEpsilon(double epsilon) { m_transformationEpsilon = epsilon; }
+  void setEuclideanFitnessEpsilon(double epsilon) { m_fitnessEpsilon = epsilon; }
+  void setMaxCorrespondenceDistance(double distance) { m_maxCorrespondenceDistance = distance; }
+
+  void setInputSource(PointCloud::ConstPtr source) { m_source = source; }
+  void setInputTarget(PointCloud::ConstPtr target);
+
+  // uses tree (built on the target cloud) instead of building one
+  void setSearchMethodTarget(KdTree::Ptr tree, bool forceNoRecompute = false);
+  KdTree::Ptr getSearchMethodTarget() const { return m_tree; }
+
+  // writes the source, transformed by the final transformation, to output
+  void align(PointCloud& output, const Eigen::Matrix4f& guess);
+  void align(PointCloud& output) { align(output, Eigen::Matrix4f::Identity()); }
+
+  bool hasConverged() const { return m_converged; }
+  // converged by one of the epsilons rather than the iteration limit
+  bool hasSettled() const { return m_settled; }
+  Eigen::Matrix4f getFinalTransformation() const { return m_finalTransformation; }
+  double getFitnessScore() const { return m_fitnessScore; }
+  int iterations() const { return m_iterations; }
+
+  // per source point: index of its nearest target point (-1 if none) and
+  // the squared distance to it after the final transformation
+  const std::vector<int>& correspondences() const { return m_correspondences; }
+  const std::vector<float>& sqrResiduals() const { return m_sqrResiduals; }
+
+private:
+  PointCloud::ConstPtr m_source;
+  PointCloud::ConstPtr m_target;
+  KdTree::Ptr m_tree;
+  bool m_treeFromUser;
+  int m_maxIterations;
+  double m_transformationEpsilon;
+  double m_fitnessEpsilon;
+  double m_maxCorrespondenceDistance;
+
+  bool m_converged;
+  bool m_settled;
+  int m_iterations;
+  Eigen::Matrix4f m_finalTransformation;
+  PointCloud m_aligned;
+  std::vector<int> m_correspondences;
+  std::vector<float> m_sqrResiduals;
+  double m_fitnessScore;
+};
+
+} // namespace librigidbodytracker
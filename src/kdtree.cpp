@@ -0,0 +1,162 @@
+#include "kdtree.hpp"
+
+#include <algorithm>
+
+namespace librigidbodytracker {
+
+static float coordinate(const PointXYZ& p, int axis)
+{
+  return axis == 0 ? p.x : (axis == 1 ? p.y : p.z);
+}
+
+static float sqrDistance(const PointXYZ& p, const float* q)
+{
+  float dx = p.x - q[0];
+  float dy = p.y - q[1];
+  float dz = p.z - q[2];
+  return dx * dx + dy * dy + dz * dz;
+}
+
+KdTree::KdTree()
+  : m_cloud()
+  , m_nodes()
+  , m_root(-1)
+{
+}
+
+void KdTree::setInputCloud(PointCloud::ConstPtr cloud)
+{
+  m_cloud = cloud;
+  m_nodes.clear();
+  m_nodes.reserve(cloud->size());
+  std::vector<int> indices(cloud->size());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    indices[i] = i;
+  }
+  m_root = build(indices, 0, indices.size());
+}
+
+int KdTree::build(std::vector<int>& indices, size_t begin, size_t end)
+{
+  if (begin >= end) {
+    return -1;
+  }
+
+  // split along the axis of largest extent
+  float lo[3] = {coordinate((*m_cloud)[indices[begin]], 0), coordinate((*m_cloud)[indices[begin]], 1), coordinate((*m_cloud)[indices[begin]], 2)};
+  float hi[3] = {lo[0], lo[1], lo[2]};
+  for (size_t i = begin + 1; i < end; ++i) {
+    for (int a = 0; a < 3; ++a) {
+      float c = coordinate((*m_cloud)[indices[i]], a);
+      lo[a] = std::min(lo[a], c);
+      hi[a] = std::max(hi[a], c);
+    }
+  }
+  int axis = 0;
+  for (int a = 1; a < 3; ++a) {
+    if (hi[a] - lo[a] > hi[axis] - lo[axis]) {
+      axis = a;
+    }
+  }
+
+  size_t mid = begin + (end - begin) / 2;
+  std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end,
+    [this, axis](int a, int b) {
+      return coordinate((*m_cloud)[a], axis) < coordinate((*m_cloud)[b], axis);
+    });
+
+  int node = m_nodes.size();
+  m_nodes.push_back({indices[mid], axis, -1, -1});
+  int left = build(indices, begin, mid);
+  int right = build(indices, mid + 1, end);
+  m_nodes[node].left = left;
+  m_nodes[node].right = right;
+  return node;
+}
+
+int KdTree::nearestKSearch(const PointXYZ& p, int k,
+  std::vector<int>& indices, std::vector<float>& sqrDistances) const
+{
+  indices.clear();
+  sqrDistances.clear();
+  if (k <= 0 || m_root < 0) {
+    return 0;
+  }
+
+  // max-heap of the best k candidates found so far
+  std::vector<std::pair<float, int>> heap;
+  heap.reserve(k + 1);
+  float const query[3] = {p.x, p.y, p.z};
+  nearest(m_root, query, k, heap);
+
+  std::sort_heap(heap.begin(), heap.end());
+  for (const auto& h : heap) {
+    indices.push_back(h.second);
+    sqrDistances.push_back(h.first);
+  }
+  return indices.size();
+}
+
+void KdTree::nearest(int node, const float* query, size_t k,
+  std::vector<std::pair<float, int>>& heap) const
+{
+  if (node < 0) {
+    return;
+  }
+  const Node& n = m_nodes[node];
+  const PointXYZ& p = (*m_cloud)[n.point];
+
+  float d = sqrDistance(p, query);
+  if (heap.size() < k) {
+    heap.emplace_back(d, n.point);
+    std::push_heap(heap.begin(), heap.end());
+  } else if (d < heap.front().first) {
+    std::pop_heap(heap.begin(), heap.end());
+    heap.back() = std::make_pair(d, n.point);
+    std::push_heap(heap.begin(), heap.end());
+  }
+
+  float diff = query[n.axis] - coordinate(p, n.axis);
+  int nearSide = diff < 0 ? n.left : n.right;
+  int farSide = diff < 0 ? n.right : n.left;
+  nearest(nearSide, query, k, heap);
+  if (heap.size() < k || diff * diff < heap.front().first) {
+    nearest(farSide, query, k, heap);
+  }
+}
+
+int KdTree::radiusSearch(const PointXYZ& p, double radius,
+  std::vector<int>& indices, std::vector<float>& sqrDistances) const
+{
+  indices.clear();
+  sqrDistances.clear();
+  float const query[3] = {p.x, p.y, p.z};
+  this->radius(m_root, query, radius * radius, indices, sqrDistances);
+  return indices.size();
+}
+
+void KdTree::radius(int node, const float* query, float sqrRadius,
+  std::vector<int>& indices, std::vector<float>& sqrDistances) const
+{
+  if (node < 0) {
+    return;
+  }
+  const Node& n = m_nodes[node];
+  const PointXYZ& p = (*m_cloud)[n.point];
+
+  float d = sqrDistance(p, query);
+  if (d <= sqrRadius) {
+    indices.push_back(n.point);
+    sqrDistances.push_back(d);
+  }
+
+  float diff = query[n.axis] - coordinate(p, n.axis);
+  int nearSide = diff < 0 ? n.left : n.right;
+  int farSide = diff < 0 ? n.right : n.left;
+  radius(nearSide, query, sqrRadius, indices, sqrDistances);
+  if (diff * diff <= sqrRadius) {
+    radius(farSide, query, sqrRadius, indices, sqrDistances);
+  }
+}
+
+} // namespace librigidbodytracker
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "librigidbodytracker/point_cloud.h"
+
+namespace librigidbodytracker {
+
+/*! \brief Static kd-tree over a point cloud
+
+Built once per cloud (per frame); queries are const and may run
+concurrently. Result conventions follow pcl::search::KdTree: squared
+distances, nearest neighbors sorted by distance.
+*/
+class KdTree
+{
+public:
+  typedef std::shared_ptr<KdTree> Ptr;
+
+  KdTree();
+
+  void setInputCloud(PointCloud::ConstPtr cloud);
+  PointCloud::ConstPtr getInputCloud() const { return m_cloud; }
+
+  // the k nearest neighbors of p, closest first
+  int nearestKSearch(const PointXYZ& p, int k,
+    std::vector<int>& indices, std::vector<float>& sqrDistances) const;
+
+  // all points within radius of p, in no particular order
+  int radiusSearch(const PointXYZ& p, double radius,
+    std::vector<int>& indices, std::vector<float>& sqrDistances) const;
+
+private:
+  struct Node
+  {
+    // index into m_cloud
+    int point;
+    int axis;
+    int left;
+    int right;
+  };
+
+  int build(std::vector<int>& indices, size_t begin, size_t end);
+
+  void nearest(int node, const float* query, size_t k,
+    std::vector<std::pair<float, int>>& heap) const;
+
+  void radius(int node, const float* query, float sqrRadius,
+    std::vector<int>& indices, std::vector<float>& sqrDistances) const;
+
+private:
+  PointCloud::ConstPtr m_cloud;
+  std::vector<Node> m_nodes;
+  int m_root;
+};
+
+} // namespace librigidbodytracker
@@ -0,0 +1,73 @@
+#include "latest_frame_worker.hpp"
+
+namespace librigidbodytracker {
+
+LatestFrameWorker::LatestFrameWorker()
+  : m_job()
+  , m_running(false)
+  , m_stop(false)
+  , m_thread()
+{
+  m_thread = std::thread(&LatestFrameWorker::run, this);
+}
+
+LatestFrameWorker::~LatestFrameWorker()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_job = nullptr;
+  }
+  m_cv.notify_all();
+  m_thread.join();
+}
+
+bool LatestFrameWorker::submit(std::function<void()> job)
+{
+  bool replaced;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    replaced = bool(m_job);
+    m_job = std::move(job);
+  }
+  m_cv.notify_one();
+  return replaced;
+}
+
+bool LatestFrameWorker::pending() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return bool(m_job);
+}
+
+void LatestFrameWorker::wait()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_idle.wait(lock, [this]() { return !m_job && !m_running; });
+}
+
+void LatestFrameWorker::run()
+{
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this]() { return m_stop || bool(m_job); });
+      if (m_stop) {
+        m_idle.notify_all();
+        return;
+      }
+      job = std::move(m_job);
+      m_job = nullptr;
+      m_running = true;
+    }
+    job();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_running = false;
+    }
+    m_idle.notify_all();
+  }
+}
+
+} // namespace librigidbodytracker
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace librigidbodytracker {
+
+/*! \brief Background thread that only ever runs the newest job
+
+Holds at most one pending job besides the running one: submitting while a
+job is pending replaces it. Used for frame ingest that keeps latency bounded
+by skipping frames instead of queueing them.
+*/
+class LatestFrameWorker
+{
+public:
+  LatestFrameWorker();
+  // finishes a running job; a pending one is dropped
+  ~LatestFrameWorker();
+
+  LatestFrameWorker(const LatestFrameWorker&) = delete;
+  LatestFrameWorker& operator=(const LatestFrameWorker&) = delete;
+
+  // returns true if a pending job was replaced
+  bool submit(std::function<void()> job);
+
+  // true while a job waits for the running one to finish
+  bool pending() const;
+
+  // blocks until no job is pending or running
+  void wait();
+
+private:
+  void run();
+
+private:
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::condition_variable m_idle;
+  std::function<void()> m_job;
+  bool m_running;
+  bool m_stop;
+  std::thread m_thread;
+};
+
+} // namespace librigidbodytracker
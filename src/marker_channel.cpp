@@ -0,0 +1,180 @@
+#include "librigidbodytracker/marker_channel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "shared_memory.hpp"
+
+namespace librigidbodytracker {
+
+namespace {
+
+  const char MarkerChannelMagic[8] = {'L', 'R', 'B', 'T', 'M', 'R', 'K', '\0'};
+
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+    "the marker channel needs lock-free 64 bit atomics to work across processes");
+
+  size_t slotSize(size_t maxMarkers)
+  {
+    // markers and ids, padded to whole cache lines
+    size_t size = sizeof(MarkerSlotHeader) + maxMarkers * (3 * sizeof(float) + sizeof(uint32_t));
+    return (size + 63) / 64 * 64;
+  }
+
+  MarkerSlotHeader* slotAt(MarkerChannelHeader* header, uint64_t frame)
+  {
+    uint8_t* base = reinterpret_cast<uint8_t*>(header) + sizeof(MarkerChannelHeader);
+    return reinterpret_cast<MarkerSlotHeader*>(
+      base + (frame % header->numSlots) * header->slotSize);
+  }
+
+  float* slotMarkers(MarkerSlotHeader* slot)
+  {
+    return reinterpret_cast<float*>(slot + 1);
+  }
+
+  uint32_t* slotIds(MarkerSlotHeader* slot, size_t maxMarkers)
+  {
+    return reinterpret_cast<uint32_t*>(slotMarkers(slot) + 3 * maxMarkers);
+  }
+
+} // anonymous namespace
+
+MarkerChannelProducer::MarkerChannelProducer(const std::string& name, size_t maxMarkers, size_t numSlots)
+  : m_memory()
+  , m_header(nullptr)
+{
+  if (numSlots < 2) {
+    throw std::runtime_error("MarkerChannelProducer: need at least two slots.");
+  }
+  m_memory.reset(new SharedMemory(name,
+    sizeof(MarkerChannelHeader) + numSlots * slotSize(maxMarkers)));
+
+  m_header = static_cast<MarkerChannelHeader*>(m_memory->data());
+  std::memcpy(m_header->magic, MarkerChannelMagic, sizeof(MarkerChannelMagic));
+  m_header->version = MarkerChannelVersion;
+  m_header->numSlots = numSlots;
+  m_header->maxMarkers = maxMarkers;
+  m_header->slotSize = slotSize(maxMarkers);
+  m_header->droppedCount.store(0, std::memory_order_relaxed);
+  m_header->readCount.store(0, std::memory_order_relaxed);
+  m_header->writeCount.store(0, std::memory_order_release);
+}
+
+MarkerChannelProducer::~MarkerChannelProducer()
+{
+}
+
+bool MarkerChannelProducer::push(std::chrono::high_resolution_clock::time_point stamp,
+  const MarkerView& markers)
+{
+  uint64_t const frame = m_header->writeCount.load(std::memory_order_relaxed);
+  // the consumer releases a slot only after it is done reading it
+  if (frame - m_header->readCount.load(std::memory_order_acquire) >= m_header->numSlots) {
+    m_header->droppedCount.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  MarkerSlotHeader* slot = slotAt(m_header, frame);
+  size_t const numMarkers = std::min<size_t>(markers.count, m_header->maxMarkers);
+  slot->stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    stamp.time_since_epoch()).count();
+  slot->numMarkers = numMarkers;
+  slot->hasIds = markers.ids != nullptr;
+
+  float* xyz = slotMarkers(slot);
+  if (markers.stride == 3 * sizeof(float)) {
+    std::memcpy(xyz, markers.data, numMarkers * 3 * sizeof(float));
+  } else {
+    for (size_t i = 0; i < numMarkers; ++i) {
+      std::memcpy(xyz + 3 * i, markers.marker(i), 3 * sizeof(float));
+    }
+  }
+  if (markers.ids) {
+    std::memcpy(slotIds(slot, m_header->maxMarkers), markers.ids, numMarkers * sizeof(uint32_t));
+  }
+
+  m_header->writeCount.store(frame + 1, std::memory_order_release);
+  return true;
+}
+
+size_t MarkerChannelProducer::pending() const
+{
+  return m_header->writeCount.load(std::memory_order_relaxed)
+    - m_header->readCount.load(std::memory_order_acquire);
+}
+
+size_t MarkerChannelProducer::numSlots() const
+{
+  return m_header->numSlots;
+}
+
+uint64_t MarkerChannelProducer::droppedCount() const
+{
+  return m_header->droppedCount.load(std::memory_order_relaxed);
+}
+
+/////////////////////////////////////////////////////////////
+
+MarkerChannelConsumer::MarkerChannelConsumer(const std::string& name)
+  : m_memory(new SharedMemory(name, true))
+  , m_header(static_cast<MarkerChannelHeader*>(m_memory->data()))
+{
+  if (m_memory->size() < sizeof(MarkerChannelHeader)
+      || std::memcmp(m_header->magic, MarkerChannelMagic, sizeof(MarkerChannelMagic)) != 0) {
+    throw std::runtime_error("MarkerChannelConsumer: " + name + " is not a marker channel.");
+  }
+  if (m_header->version != MarkerChannelVersion) {
+    throw std::runtime_error("MarkerChannelConsumer: " + name + " has unsupported version "
+      + std::to_string(m_header->version) + ".");
+  }
+  if (m_header->numSlots == 0
+      || m_header->slotSize < slotSize(m_header->maxMarkers)
+      || m_memory->size() < sizeof(MarkerChannelHeader) + size_t(m_header->numSlots) * m_header->slotSize) {
+    throw std::runtime_error("MarkerChannelConsumer: " + name + " is truncated.");
+  }
+}
+
+MarkerChannelConsumer::~MarkerChannelConsumer()
+{
+}
+
+bool MarkerChannelConsumer::peek(std::chrono::high_resolution_clock::time_point& stamp,
+  MarkerView& markers) const
+{
+  uint64_t const frame = m_header->readCount.load(std::memory_order_relaxed);
+  if (m_header->writeCount.load(std::memory_order_acquire) == frame) {
+    return false;
+  }
+
+  MarkerSlotHeader* slot = slotAt(m_header, frame);
+  size_t const maxMarkers = m_header->maxMarkers;
+  stamp = std::chrono::high_resolution_clock::time_point(
+    std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+      std::chrono::nanoseconds(slot->stamp)));
+  markers = MarkerView(slotMarkers(slot), std::min<size_t>(slot->numMarkers, maxMarkers),
+    3 * sizeof(float), slot->hasIds ? slotIds(slot, maxMarkers) : nullptr);
+  return true;
+}
+
+void MarkerChannelConsumer::release()
+{
+  uint64_t const frame = m_header->readCount.load(std::memory_order_relaxed);
+  if (m_header->writeCount.load(std::memory_order_acquire) != frame) {
+    m_header->readCount.store(frame + 1, std::memory_order_release);
+  }
+}
+
+size_t MarkerChannelConsumer::pending() const
+{
+  return m_header->writeCount.load(std::memory_order_acquire)
+    - m_header->readCount.load(std::memory_order_relaxed);
+}
+
+uint64_t MarkerChannelConsumer::droppedCount() const
+{
+  return m_header->droppedCount.load(std::memory_order_relaxed);
+}
+
+} // namespace librigidbodytracker
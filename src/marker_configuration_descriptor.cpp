@@ -0,0 +1,111 @@
+#include "marker_configuration_descriptor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <Eigen/Geometry>
+
+using Point = librigidbodytracker::PointXYZ;
+using Cloud = librigidbodytracker::PointCloud;
+
+namespace librigidbodytracker {
+
+static Eigen::Vector3f pcl2eig(const Point& p)
+{
+  return Eigen::Vector3f(p.x, p.y, p.z);
+}
+
+// true if rotating all points by yaw maps them onto points of the set
+static bool isYawSymmetric(
+  const std::vector<Eigen::Vector3f>& points,
+  float yaw,
+  float tolerance)
+{
+  Eigen::Matrix3f rotation = Eigen::AngleAxisf(yaw, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+  for (const auto& p : points) {
+    Eigen::Vector3f rotated = rotation * p;
+    bool matched = false;
+    for (const auto& q : points) {
+      if ((rotated - q).norm() < tolerance) {
+        matched = true;
+        break;
+      }
+    }
+    if (!matched) {
+      return false;
+    }
+  }
+  return true;
+}
+
+MarkerConfigurationDescriptorPtr describeMarkerConfiguration(
+  Cloud::ConstPtr points,
+  float symmetryTolerance)
+{
+  std::shared_ptr<MarkerConfigurationDescriptor> desc(new MarkerConfigurationDescriptor);
+  desc->points = points;
+  desc->numMarkers = points->size();
+  desc->offset = points->empty() ? Eigen::Vector3f::Zero() : pcl2eig((*points)[0]);
+
+  std::vector<Eigen::Vector3f> body;
+  desc->centroid = Eigen::Vector3f::Zero();
+  desc->radius = 0;
+  for (const Point& p : *points) {
+    body.push_back(pcl2eig(p));
+    desc->centroid += body.back();
+    desc->radius = std::max(desc->radius, body.back().norm());
+  }
+  if (!body.empty()) {
+    desc->centroid /= body.size();
+  }
+  desc->centroidRadius = 0;
+  desc->spread = 0;
+  for (const auto& p : body) {
+    desc->demeaned.push_back(p - desc->centroid);
+    desc->centroidRadius = std::max(desc->centroidRadius, desc->demeaned.back().norm());
+    desc->spread += desc->demeaned.back().squaredNorm();
+  }
+  if (!body.empty()) {
+    desc->spread /= body.size();
+  }
+
+  size_t const n = body.size();
+  desc->pairwiseDistances = Eigen::MatrixXf::Zero(n, n);
+  desc->minPairwiseDistance = std::numeric_limits<float>::max();
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = i + 1; j < n; ++j) {
+      float dist = (body[i] - body[j]).norm();
+      desc->pairwiseDistances(i, j) = dist;
+      desc->pairwiseDistances(j, i) = dist;
+      desc->minPairwiseDistance = std::min(desc->minPairwiseDistance, dist);
+    }
+  }
+
+  // the yaw search rotates about the body origin, so check the n-fold
+  // symmetries about its z axis, highest order first
+  desc->yawSymmetry = 2 * M_PI;
+  for (size_t order = n; order >= 2; --order) {
+    if (isYawSymmetric(body, 2 * M_PI / order, symmetryTolerance)) {
+      desc->yawSymmetry = 2 * M_PI / order;
+      break;
+    }
+  }
+
+  int const numSeeds = std::max<int>(1,
+    std::ceil(MarkerConfigurationDescriptor::NumYawSeeds * desc->yawSymmetry / (2 * M_PI) - 1e-3));
+  for (int i = 0; i < numSeeds; ++i) {
+    float yaw = i * (2 * M_PI / MarkerConfigurationDescriptor::NumYawSeeds);
+    Eigen::Matrix3f rotation = Eigen::AngleAxisf(yaw, Eigen::Vector3f::UnitZ()).toRotationMatrix();
+    Cloud::Ptr rotated(new Cloud);
+    for (const auto& p : body) {
+      Eigen::Vector3f r = rotation * p;
+      rotated->push_back(Point(r.x(), r.y(), r.z()));
+    }
+    desc->seedYaws.push_back(yaw);
+    desc->yawTemplates.push_back(rotated);
+  }
+  return desc;
+}
+
+} // namespace librigidbodytracker
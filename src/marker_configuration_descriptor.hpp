@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+#include "librigidbodytracker/point_cloud.h"
+
+namespace librigidbodytracker {
+
+/*! \brief Immutable facts about a marker configuration
+
+Built once per configuration when the tracker is constructed, so the per
+frame code does not re-derive them. All quantities are expressed in the
+rigid body frame.
+*/
+struct MarkerConfigurationDescriptor
+{
+  // number of yaw seeds spanning a full turn during pose search
+  static int const NumYawSeeds = 20;
+
+  PointCloud::ConstPtr points;
+  size_t numMarkers;
+  // position of the first marker; the whole body for single-marker bodies
+  Eigen::Vector3f offset;
+  Eigen::Vector3f centroid;
+  // points minus centroid
+  std::vector<Eigen::Vector3f> demeaned;
+  // largest distance of a marker from the centroid, and mean squared
+  // distance of the markers from it; both do not depend on the orientation
+  float centroidRadius;
+  float spread;
+  // distances between all pairs of markers
+  Eigen::MatrixXf pairwiseDistances;
+  float minPairwiseDistance;
+  // largest distance of a marker from the body origin
+  float radius;
+  // smallest yaw (rad) that maps the configuration onto itself; 2 pi for
+  // configurations without rotational symmetry about z
+  float yawSymmetry;
+  // points rotated by the yaw seeds within [0, yawSymmetry)
+  std::vector<float> seedYaws;
+  std::vector<PointCloud::ConstPtr> yawTemplates;
+};
+
+typedef std::shared_ptr<const MarkerConfigurationDescriptor> MarkerConfigurationDescriptorPtr;
+
+// markers closer than symmetryTolerance (m) are considered equal
+MarkerConfigurationDescriptorPtr describeMarkerConfiguration(
+  PointCloud::ConstPtr points,
+  float symmetryTolerance = 0.002);
+
+} // namespace librigidbodytracker
@@ -0,0 +1,132 @@
+#include "marker_prefilter.hpp"
+
+#include "kdtree.hpp"
+
+using Point = librigidbodytracker::PointXYZ;
+using Cloud = librigidbodytracker::PointCloud;
+
+namespace librigidbodytracker {
+
+MarkerPrefilter::MarkerPrefilter(const PrefilterConfiguration& configuration)
+  : m_configuration(configuration)
+  , m_previousMarkers(new Cloud)
+  , m_previousCounts()
+{
+}
+
+void MarkerPrefilter::filter(
+  Cloud::ConstPtr input,
+  const std::vector<uint32_t>& ids,
+  const std::vector<Gate>& gates,
+  Cloud& output,
+  PrefilterStatistics& statistics)
+{
+  statistics = PrefilterStatistics();
+  statistics.inputMarkers = input->size();
+
+  const PrefilterConfiguration& cfg = m_configuration;
+  Cloud::Ptr inside(new Cloud);
+  inside->reserve(input->size());
+  std::vector<uint32_t> insideIds;
+  for (size_t i = 0; i < input->size(); ++i) {
+    const Point& p = (*input)[i];
+    if (cfg.useBoundingBox
+        && (p.x < cfg.lowerBound.x() || p.x > cfg.upperBound.x()
+         || p.y < cfg.lowerBound.y() || p.y > cfg.upperBound.y()
+         || p.z < cfg.lowerBound.z() || p.z > cfg.upperBound.z())) {
+      ++statistics.outsideVolume;
+      continue;
+    }
+    inside->push_back(p);
+    if (!ids.empty()) {
+      insideIds.push_back(ids[i]);
+    }
+  }
+
+  // persistence is tracked on all markers inside the volume, such that a
+  // marker may become relevant once a rigid body approaches it
+  Cloud::Ptr candidates(new Cloud);
+  if (cfg.minPersistence > 1) {
+    std::vector<size_t> counts;
+    updatePersistence(inside, insideIds, counts);
+    candidates->reserve(inside->size());
+    for (size_t i = 0; i < inside->size(); ++i) {
+      if (counts[i] >= cfg.minPersistence) {
+        candidates->push_back((*inside)[i]);
+      } else {
+        ++statistics.notPersistent;
+      }
+    }
+  } else {
+    candidates = inside;
+  }
+
+  output.clear();
+  if (cfg.gatingDistance <= 0 || candidates->empty()) {
+    output = *candidates;
+    statistics.outputMarkers = output.size();
+    return;
+  }
+
+  KdTree kdtree;
+  kdtree.setInputCloud(candidates);
+  std::vector<bool> gated(candidates->size(), false);
+  std::vector<int> nnIndices;
+  std::vector<float> nnDistances;
+  for (const Gate& gate : gates) {
+    Point center(gate.center.x(), gate.center.y(), gate.center.z());
+    kdtree.radiusSearch(center, gate.radius, nnIndices, nnDistances);
+    for (int idx : nnIndices) {
+      gated[idx] = true;
+    }
+  }
+  output.reserve(candidates->size());
+  for (size_t i = 0; i < candidates->size(); ++i) {
+    if (gated[i]) {
+      output.push_back((*candidates)[i]);
+    } else {
+      ++statistics.outsideGates;
+    }
+  }
+  statistics.outputMarkers = output.size();
+}
+
+void MarkerPrefilter::updatePersistence(
+  Cloud::ConstPtr cloud,
+  const std::vector<uint32_t>& ids,
+  std::vector<size_t>& counts)
+{
+  counts.assign(cloud->size(), 1);
+  if (!ids.empty()) {
+    std::unordered_map<uint32_t, size_t> countsById;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      auto it = m_previousCountsById.find(ids[i]);
+      if (it != m_previousCountsById.end()) {
+        counts[i] = it->second + 1;
+      }
+      countsById[ids[i]] = counts[i];
+    }
+    m_previousCountsById.swap(countsById);
+    m_previousMarkers->clear();
+    return;
+  }
+
+  m_previousCountsById.clear();
+  if (!m_previousMarkers->empty()) {
+    KdTree kdtree;
+    kdtree.setInputCloud(m_previousMarkers);
+    std::vector<int> nnIndices(1);
+    std::vector<float> nnDistances(1);
+    float const maxSqDist = m_configuration.persistenceRadius * m_configuration.persistenceRadius;
+    for (size_t i = 0; i < cloud->size(); ++i) {
+      if (kdtree.nearestKSearch((*cloud)[i], 1, nnIndices, nnDistances) == 1
+          && nnDistances[0] <= maxSqDist) {
+        counts[i] = m_previousCounts[nnIndices[0]] + 1;
+      }
+    }
+  }
+  *m_previousMarkers = *cloud;
+  m_previousCounts = counts;
+}
+
+} // namespace librigidbodytracker
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "librigidbodytracker/rigid_body_tracker.h"
+
+namespace librigidbodytracker {
+
+/*! \brief Drops reflections and stray markers before the tracking stages
+
+Markers pass three checks, in this order:
+- they lie inside the configured volume,
+- they were seen in the previous frames (persistence; by id if the input
+  has marker ids, otherwise by proximity), and
+- they lie within the gate of at least one rigid body.
+The gates are spheres around the predicted rigid body positions, queried
+through a kd-tree of the markers.
+*/
+class MarkerPrefilter
+{
+public:
+  struct Gate
+  {
+    Eigen::Vector3f center;
+    float radius;
+  };
+
+  explicit MarkerPrefilter(const PrefilterConfiguration& configuration);
+
+  const PrefilterConfiguration& configuration() const { return m_configuration; }
+
+  // writes the accepted markers to output; ids are either empty or one
+  // per input marker
+  void filter(
+    PointCloud::ConstPtr input,
+    const std::vector<uint32_t>& ids,
+    const std::vector<Gate>& gates,
+    PointCloud& output,
+    PrefilterStatistics& statistics);
+
+private:
+  // number of consecutive frames each marker in cloud was seen in
+  void updatePersistence(PointCloud::ConstPtr cloud,
+    const std::vector<uint32_t>& ids,
+    std::vector<size_t>& counts);
+
+private:
+  PrefilterConfiguration m_configuration;
+  PointCloud::Ptr m_previousMarkers;
+  std::vector<size_t> m_previousCounts;
+  std::unordered_map<uint32_t, size_t> m_previousCountsById;
+};
+
+} // namespace librigidbodytracker
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <fstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace librigidbodytracker {
+
+// Frame of a point cloud recording (see cloudlog.hpp for the format), read
+// without PCL for the stand-in driver tools
+struct RecordedFrame
+{
+  uint32_t millis;
+  // x, y, z per marker
+  std::vector<float> markers;
+};
+
+inline std::vector<RecordedFrame> loadRecording(const std::string& path)
+{
+  std::ifstream s(path, std::ios::binary | std::ios::in);
+  if (!s) {
+    throw std::runtime_error("cannot open recording " + path);
+  }
+  std::vector<RecordedFrame> frames;
+  RecordedFrame frame;
+  uint32_t size;
+  while (s.read(reinterpret_cast<char*>(&frame.millis), sizeof(frame.millis))
+      && s.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+    frame.markers.resize(3 * size);
+    if (!s.read(reinterpret_cast<char*>(frame.markers.data()), frame.markers.size() * sizeof(float))) {
+      break;
+    }
+    frames.push_back(frame);
+  }
+  return frames;
+}
+
+} // namespace librigidbodytracker
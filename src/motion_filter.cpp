@@ -0,0 +1,76 @@
+#include "librigidbodytracker/motion_filter.h"
+
+namespace librigidbodytracker {
+
+MotionFilter::MotionFilter()
+  : m_initialized(false)
+  , m_stamp()
+  , m_position(Eigen::Vector3f::Zero())
+  , m_velocity(Eigen::Vector3f::Zero())
+  , m_varPosition(Eigen::Vector3f::Zero())
+  , m_cov(Eigen::Vector3f::Zero())
+  , m_varVelocity(Eigen::Vector3f::Zero())
+{
+}
+
+void MotionFilter::reset(
+  std::chrono::high_resolution_clock::time_point stamp,
+  const Eigen::Vector3f& position,
+  const Eigen::Vector3f& velocityVariance,
+  double measurementVariance)
+{
+  m_initialized = true;
+  m_stamp = stamp;
+  m_position = position;
+  m_velocity.setZero();
+  m_varPosition.setConstant(measurementVariance);
+  m_cov.setZero();
+  m_varVelocity = velocityVariance;
+}
+
+void MotionFilter::update(
+  std::chrono::high_resolution_clock::time_point stamp,
+  const Eigen::Vector3f& position,
+  double processNoise,
+  double measurementVariance)
+{
+  std::chrono::duration<double> elapsedSeconds = stamp - m_stamp;
+  float const dt = elapsedSeconds.count();
+  float const q = processNoise;
+  for (int i = 0; i < 3; ++i) {
+    // predict: x = F x, P = F P F^T + Q
+    float p = m_position[i] + dt * m_velocity[i];
+    float v = m_velocity[i];
+    float pp = m_varPosition[i] + 2 * dt * m_cov[i] + dt * dt * m_varVelocity[i] + q * dt * dt * dt / 3;
+    float pv = m_cov[i] + dt * m_varVelocity[i] + q * dt * dt / 2;
+    float vv = m_varVelocity[i] + q * dt;
+
+    // correct with a measurement of the position
+    float s = pp + measurementVariance;
+    float kp = pp / s;
+    float kv = pv / s;
+    float innovation = position[i] - p;
+    m_position[i] = p + kp * innovation;
+    m_velocity[i] = v + kv * innovation;
+    m_varPosition[i] = (1 - kp) * pp;
+    m_cov[i] = (1 - kp) * pv;
+    m_varVelocity[i] = vv - kv * pv;
+  }
+  m_stamp = stamp;
+}
+
+void MotionFilter::predict(
+  std::chrono::high_resolution_clock::time_point stamp,
+  double processNoise,
+  Eigen::Vector3f& position,
+  Eigen::Vector3f& positionVariance) const
+{
+  std::chrono::duration<double> elapsedSeconds = stamp - m_stamp;
+  float const dt = elapsedSeconds.count();
+  float const q = processNoise;
+  position = m_position + dt * m_velocity;
+  positionVariance = m_varPosition + 2 * dt * m_cov + dt * dt * m_varVelocity
+    + Eigen::Vector3f::Constant(q * dt * dt * dt / 3);
+}
+
+} // namespace librigidbodytracker
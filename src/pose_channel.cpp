@@ -0,0 +1,177 @@
+#include "librigidbodytracker/pose_channel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <Eigen/Geometry>
+
+#include "librigidbodytracker/rigid_body_tracker.h"
+#include "shared_memory.hpp"
+
+namespace librigidbodytracker {
+
+namespace {
+
+  const char PoseChannelMagic[8] = {'L', 'R', 'B', 'T', 'P', 'O', 'S', '\0'};
+
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+    "the pose channel needs lock-free 64 bit atomics to work across processes");
+
+  PoseSlotHeader* slotAt(PoseChannelHeader* header, uint64_t frame)
+  {
+    uint8_t* base = reinterpret_cast<uint8_t*>(header) + sizeof(PoseChannelHeader);
+    return reinterpret_cast<PoseSlotHeader*>(
+      base + (frame % header->numSlots) * header->slotSize);
+  }
+
+  const PoseSlotHeader* slotAt(const PoseChannelHeader* header, uint64_t frame)
+  {
+    return slotAt(const_cast<PoseChannelHeader*>(header), frame);
+  }
+
+  size_t slotSize(size_t maxRigidBodies)
+  {
+    return sizeof(PoseSlotHeader) + maxRigidBodies * sizeof(PublishedPose);
+  }
+
+} // anonymous namespace
+
+PosePublisher::PosePublisher(const std::string& name, size_t maxRigidBodies, size_t numSlots)
+  : m_memory()
+  , m_header(nullptr)
+{
+  if (numSlots < 2) {
+    throw std::runtime_error("PosePublisher: need at least two slots.");
+  }
+  m_memory.reset(new SharedMemory(name,
+    sizeof(PoseChannelHeader) + numSlots * slotSize(maxRigidBodies)));
+
+  // the segment is zero-filled, so readers see no frames until frameCount
+  // is published below
+  m_header = static_cast<PoseChannelHeader*>(m_memory->data());
+  std::memcpy(m_header->magic, PoseChannelMagic, sizeof(PoseChannelMagic));
+  m_header->version = PoseChannelVersion;
+  m_header->numSlots = numSlots;
+  m_header->maxRigidBodies = maxRigidBodies;
+  m_header->slotSize = slotSize(maxRigidBodies);
+  m_header->frameCount.store(0, std::memory_order_release);
+}
+
+PosePublisher::~PosePublisher()
+{
+}
+
+void PosePublisher::publish(std::chrono::high_resolution_clock::time_point stamp,
+  const std::vector<RigidBody>& rigidBodies)
+{
+  uint64_t const frame = m_header->frameCount.load(std::memory_order_relaxed);
+  PoseSlotHeader* slot = slotAt(m_header, frame);
+  PublishedPose* poses = reinterpret_cast<PublishedPose*>(slot + 1);
+
+  slot->seq.store(2 * frame + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  size_t const numRigidBodies = std::min<size_t>(rigidBodies.size(), m_header->maxRigidBodies);
+  slot->stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    stamp.time_since_epoch()).count();
+  slot->numRigidBodies = numRigidBodies;
+  for (size_t i = 0; i < numRigidBodies; ++i) {
+    const RigidBody& rigidBody = rigidBodies[i];
+    PublishedPose& pose = poses[i];
+    std::memset(&pose, 0, sizeof(pose));
+    std::strncpy(pose.name, rigidBody.name().c_str(), sizeof(pose.name) - 1);
+    Eigen::Map<Eigen::Vector3f>(pose.position) = rigidBody.center();
+    Eigen::Quaternionf q = rigidBody.orientationAvailable()
+      ? Eigen::Quaternionf(rigidBody.transformation().rotation())
+      : Eigen::Quaternionf::Identity();
+    Eigen::Map<Eigen::Vector4f>(pose.orientation) = q.coeffs();
+    pose.valid = rigidBody.lastTransformationValid();
+    pose.hasOrientation = rigidBody.orientationAvailable();
+  }
+
+  slot->seq.store(2 * frame + 2, std::memory_order_release);
+  m_header->frameCount.store(frame + 1, std::memory_order_release);
+}
+
+uint64_t PosePublisher::frameCount() const
+{
+  return m_header->frameCount.load(std::memory_order_relaxed);
+}
+
+/////////////////////////////////////////////////////////////
+
+PoseSubscriber::PoseSubscriber(const std::string& name)
+  : m_memory(new SharedMemory(name, false))
+  , m_header(static_cast<const PoseChannelHeader*>(m_memory->data()))
+{
+  if (m_memory->size() < sizeof(PoseChannelHeader)
+      || std::memcmp(m_header->magic, PoseChannelMagic, sizeof(PoseChannelMagic)) != 0) {
+    throw std::runtime_error("PoseSubscriber: " + name + " is not a pose channel.");
+  }
+  if (m_header->version != PoseChannelVersion) {
+    throw std::runtime_error("PoseSubscriber: " + name + " has unsupported version "
+      + std::to_string(m_header->version) + ".");
+  }
+  if (m_header->numSlots == 0
+      || m_header->slotSize < slotSize(m_header->maxRigidBodies)
+      || m_memory->size() < sizeof(PoseChannelHeader) + size_t(m_header->numSlots) * m_header->slotSize) {
+    throw std::runtime_error("PoseSubscriber: " + name + " is truncated.");
+  }
+}
+
+PoseSubscriber::~PoseSubscriber()
+{
+}
+
+uint64_t PoseSubscriber::frameCount() const
+{
+  return m_header->frameCount.load(std::memory_order_acquire);
+}
+
+bool PoseSubscriber::read(uint64_t frame, PublishedFrame& result) const
+{
+  const PoseSlotHeader* slot = slotAt(m_header, frame);
+  const PublishedPose* poses = reinterpret_cast<const PublishedPose*>(slot + 1);
+
+  uint64_t const seq = slot->seq.load(std::memory_order_acquire);
+  if (seq != 2 * frame + 2) {
+    return false;
+  }
+
+  // the publisher may overwrite the slot meanwhile; the copy is only used
+  // if the sequence counter did not change
+  size_t const numRigidBodies = std::min<size_t>(slot->numRigidBodies, m_header->maxRigidBodies);
+  int64_t const stamp = slot->stamp;
+  result.poses.resize(numRigidBodies);
+  std::memcpy(result.poses.data(), poses, numRigidBodies * sizeof(PublishedPose));
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot->seq.load(std::memory_order_relaxed) != seq) {
+    return false;
+  }
+
+  result.frame = frame;
+  result.stamp = std::chrono::high_resolution_clock::time_point(
+    std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+      std::chrono::nanoseconds(stamp)));
+  return true;
+}
+
+bool PoseSubscriber::readLatest(PublishedFrame& result) const
+{
+  // the newest slot is only overwritten after the publisher lapped the
+  // ring, so a second attempt practically always succeeds
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    uint64_t const count = frameCount();
+    if (count == 0) {
+      return false;
+    }
+    if (read(count - 1, result)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace librigidbodytracker
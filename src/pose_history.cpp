@@ -0,0 +1,137 @@
+#include "librigidbodytracker/pose_history.h"
+
+#include <algorithm>
+
+namespace librigidbodytracker {
+
+PoseHistory::PoseHistory(size_t capacity, double maxExtrapolation)
+  : m_capacity(std::max<size_t>(capacity, 2))
+  , m_maxExtrapolation(maxExtrapolation)
+  , m_slots(new Slot[m_capacity])
+  , m_count(0)
+{
+  for (size_t i = 0; i < m_capacity; ++i) {
+    m_slots[i].seq.store(0, std::memory_order_relaxed);
+  }
+}
+
+void PoseHistory::push(const PoseEstimate& state)
+{
+  uint64_t const index = m_count.load(std::memory_order_relaxed);
+  Slot& slot = m_slots[index % m_capacity];
+
+  slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  float const values[NumValues] = {
+    state.position.x(), state.position.y(), state.position.z(),
+    state.orientation.x(), state.orientation.y(), state.orientation.z(), state.orientation.w(),
+    state.velocity.x(), state.velocity.y(), state.velocity.z(),
+    state.hasOrientation ? 1.0f : 0.0f};
+  slot.stamp.store(state.stamp.time_since_epoch().count(), std::memory_order_relaxed);
+  for (size_t i = 0; i < NumValues; ++i) {
+    slot.values[i].store(values[i], std::memory_order_relaxed);
+  }
+
+  slot.seq.store(2 * index + 2, std::memory_order_release);
+  m_count.store(index + 1, std::memory_order_release);
+}
+
+bool PoseHistory::read(uint64_t index, PoseEstimate& state) const
+{
+  const Slot& slot = m_slots[index % m_capacity];
+  uint64_t const seq = slot.seq.load(std::memory_order_acquire);
+  if (seq != 2 * index + 2) {
+    return false;
+  }
+
+  float values[NumValues];
+  int64_t const stamp = slot.stamp.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < NumValues; ++i) {
+    values[i] = slot.values[i].load(std::memory_order_relaxed);
+  }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot.seq.load(std::memory_order_relaxed) != seq) {
+    return false;
+  }
+
+  state.stamp = std::chrono::high_resolution_clock::time_point(
+    std::chrono::high_resolution_clock::duration(stamp));
+  state.position = Eigen::Vector3f(values[0], values[1], values[2]);
+  state.orientation = Eigen::Quaternionf(values[6], values[3], values[4], values[5]);
+  state.velocity = Eigen::Vector3f(values[7], values[8], values[9]);
+  state.hasOrientation = values[10] != 0;
+  return true;
+}
+
+bool PoseHistory::latest(PoseEstimate& state) const
+{
+  while (true) {
+    uint64_t const count = m_count.load(std::memory_order_acquire);
+    if (count == 0) {
+      return false;
+    }
+    if (read(count - 1, state)) {
+      return true;
+    }
+  }
+}
+
+bool PoseHistory::at(std::chrono::high_resolution_clock::time_point stamp, PoseEstimate& state) const
+{
+  // a failed read means the writer caught up with us; start over
+  while (true) {
+    uint64_t const count = m_count.load(std::memory_order_acquire);
+    if (count == 0) {
+      return false;
+    }
+
+    PoseEstimate newer;
+    if (!read(count - 1, newer)) {
+      continue;
+    }
+    if (stamp >= newer.stamp) {
+      std::chrono::duration<double> elapsed = stamp - newer.stamp;
+      if (elapsed.count() > m_maxExtrapolation) {
+        return false;
+      }
+      state = newer;
+      state.stamp = stamp;
+      state.position += newer.velocity * elapsed.count();
+      return true;
+    }
+
+    uint64_t const oldest = count > m_capacity ? count - m_capacity : 0;
+    bool retry = false;
+    for (uint64_t index = count - 1; index > oldest; --index) {
+      PoseEstimate older;
+      if (!read(index - 1, older)) {
+        retry = true;
+        break;
+      }
+      if (older.stamp > stamp) {
+        newer = older;
+        continue;
+      }
+
+      std::chrono::duration<double> span = newer.stamp - older.stamp;
+      std::chrono::duration<double> offset = stamp - older.stamp;
+      float const alpha = span.count() > 0 ? offset.count() / span.count() : 0;
+      state.stamp = stamp;
+      state.position = older.position + alpha * (newer.position - older.position);
+      state.velocity = older.velocity + alpha * (newer.velocity - older.velocity);
+      state.hasOrientation = older.hasOrientation && newer.hasOrientation;
+      state.orientation = state.hasOrientation
+        ? older.orientation.slerp(alpha, newer.orientation)
+        : Eigen::Quaternionf::Identity();
+      return true;
+    }
+    if (!retry) {
+      // older than the history
+      return false;
+    }
+  }
+}
+
+} // namespace librigidbodytracker
@@ -0,0 +1,64 @@
+#include "reacquisition_worker.hpp"
+
+namespace librigidbodytracker {
+
+ReacquisitionWorker::ReacquisitionWorker()
+  : m_jobs()
+  , m_busy()
+  , m_stop(false)
+  , m_thread()
+{
+  m_thread = std::thread(&ReacquisitionWorker::run, this);
+}
+
+ReacquisitionWorker::~ReacquisitionWorker()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+    // queued jobs are dropped, a running one is finished
+    m_jobs.clear();
+  }
+  m_cv.notify_all();
+  m_thread.join();
+}
+
+bool ReacquisitionWorker::submit(size_t rigidBodyIdx, std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_busy.insert(rigidBodyIdx).second) {
+      return false;
+    }
+    m_jobs.emplace_back(rigidBodyIdx, std::move(job));
+  }
+  m_cv.notify_one();
+  return true;
+}
+
+bool ReacquisitionWorker::busy(size_t rigidBodyIdx) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_busy.count(rigidBodyIdx) > 0;
+}
+
+void ReacquisitionWorker::run()
+{
+  while (true) {
+    std::pair<size_t, std::function<void()>> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+      if (m_stop) {
+        return;
+      }
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+    job.second();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_busy.erase(job.first);
+  }
+}
+
+} // namespace librigidbodytracker
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+namespace librigidbodytracker {
+
+/*! \brief Background thread for expensive rigid body (re-)acquisition
+
+Runs at most one job per rigid body at a time, in submission order. Jobs
+operate on snapshots and hand their results back on their own; the worker
+only keeps track of which rigid bodies have a job queued or running.
+*/
+class ReacquisitionWorker
+{
+public:
+  ReacquisitionWorker();
+  ~ReacquisitionWorker();
+
+  ReacquisitionWorker(const ReacquisitionWorker&) = delete;
+  ReacquisitionWorker& operator=(const ReacquisitionWorker&) = delete;
+
+  // queues job, unless one for the same rigid body is queued or running
+  bool submit(size_t rigidBodyIdx, std::function<void()> job);
+
+  bool busy(size_t rigidBodyIdx) const;
+
+private:
+  void run();
+
+private:
+  mutable std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::deque<std::pair<size_t, std::function<void()>>> m_jobs;
+  std::set<size_t> m_busy;
+  bool m_stop;
+  std::thread m_thread;
+};
+
+} // namespace librigidbodytracker
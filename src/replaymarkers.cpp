@@ -0,0 +1,76 @@
+// Stand-in for the motion capture driver: replays a point cloud recording
+// (see cloudlog.hpp for the format) into a shared memory marker channel.
+#include "librigidbodytracker/marker_channel.h"
+#include "marker_recording.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace librigidbodytracker;
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    std::cerr << "use arguments: <recording> [<channel>] [--fast]\n"
+              << "  --fast: replay as fast as the consumer takes frames, instead of\n"
+              << "          in real time (dropping frames if the consumer falls behind)\n";
+    return -1;
+  }
+  std::string channelName = "/librigidbodytracker_markers";
+  bool fast = false;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--fast") {
+      fast = true;
+    } else {
+      channelName = arg;
+    }
+  }
+
+  std::vector<RecordedFrame> frames;
+  try {
+    frames = loadRecording(argv[1]);
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << "\n";
+    return -1;
+  }
+  size_t maxMarkers = 0;
+  for (const RecordedFrame& frame : frames) {
+    maxMarkers = std::max(maxMarkers, frame.markers.size() / 3);
+  }
+
+  MarkerChannelProducer producer(channelName, maxMarkers);
+  std::cout << "replaying " << frames.size() << " frames into " << channelName << "\n";
+  // give the consumer time to attach
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+
+  auto start = std::chrono::steady_clock::now();
+  for (const RecordedFrame& frame : frames) {
+    auto offset = std::chrono::milliseconds(frame.millis - frames.front().millis);
+    if (!fast) {
+      std::this_thread::sleep_until(start + offset);
+    }
+    MarkerView markers(frame.markers.data(), frame.markers.size() / 3);
+    std::chrono::high_resolution_clock::time_point stamp(std::chrono::milliseconds(frame.millis));
+    if (fast) {
+      while (producer.pending() >= producer.numSlots()) {
+        std::this_thread::yield();
+      }
+    }
+    producer.push(stamp, markers);
+  }
+
+  // keep the channel until the consumer caught up
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (producer.pending() > 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << frames.size() << " frames in " << elapsed.count() << " s, "
+            << producer.droppedCount() << " dropped\n";
+}
@@ -1,26 +1,33 @@
 #include "librigidbodytracker/rigid_body_tracker.h"
 
-// PCL
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
-#include <pcl/common/transforms.h>
-#include <pcl/registration/icp.h>
-#include <pcl/registration/transformation_estimation_2D.h>
-// #include <pcl/registration/transformation_estimation_lm.h>
-#include <pcl/search/impl/search.hpp>
-
 #include <set>
 #include "assignment.hpp"
 #include "cbs_group_constraint.hpp"
-
+#include "task_scheduler.hpp"
+#include "reacquisition_worker.hpp"
+#include "latest_frame_worker.hpp"
+#include "marker_prefilter.hpp"
+#include "marker_configuration_descriptor.hpp"
+#include "kdtree.hpp"
+#include "icp.hpp"
+#include "transforms.hpp"
+#include "binary_io.hpp"
+#include "librigidbodytracker/marker_channel.h"
+#include "librigidbodytracker/pose_channel.h"
+
+#include <algorithm>
+#include <cstring>
 #include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <Eigen/StdVector>
 
 // TEMP for debug
 #include <cstdio>
 
-using Point = pcl::PointXYZ;
-using Cloud = pcl::PointCloud<Point>;
-using ICP = pcl::IterativeClosestPoint<Point, Point>;
+using Point = librigidbodytracker::PointXYZ;
+using Cloud = librigidbodytracker::PointCloud;
+using ICP = librigidbodytracker::IterativeClosestPoint;
 
 static Eigen::Vector3f pcl2eig(Point p)
 {
@@ -39,6 +46,443 @@ static float deltaAngle(float a, float b)
 
 namespace librigidbodytracker {
 
+// Region the center of a tracked rigid body can be in at stamp, returned as
+// predicted center and per-axis semi-axes. Without motion filter that is the
+// last center and the velocity limits times dt. With motion filter, it is
+// the filter's prediction and gateSigma standard deviations, but never wider
+// than the velocity limits. dt is clamped to the re-initialization timeout,
+// since bodies without update for longer are re-acquired instead.
+static Eigen::Vector3f motionGate(
+  const RigidBody& rigidBody,
+  const DynamicsConfiguration& dynConf,
+  std::chrono::high_resolution_clock::time_point stamp,
+  Eigen::Vector3f& predictedCenter)
+{
+  std::chrono::duration<double> elapsedSeconds = stamp - rigidBody.lastValidTime();
+  double const dt = std::min(elapsedSeconds.count(), dynConf.reinitTimeout);
+  Eigen::Vector3f const limits = dt * Eigen::Vector3f(
+    dynConf.maxXVelocity, dynConf.maxYVelocity, dynConf.maxZVelocity);
+
+  const MotionFilter& filter = rigidBody.motionFilter();
+  if (!dynConf.useMotionFilter || !filter.initialized()) {
+    predictedCenter = rigidBody.center();
+    return limits;
+  }
+  Eigen::Vector3f variance;
+  filter.predict(stamp, dynConf.motionProcessNoise, predictedCenter, variance);
+  Eigen::Vector3f stdDev = (variance.array() + dynConf.measurementNoise).sqrt();
+  return (dynConf.gateSigma * stdDev).cwiseMin(limits);
+}
+
+// Finds the markers inside the ellipsoid with the given semi-axes around
+// expected, i.e., the markers a single-marker rigid body can have moved to.
+// Results are sorted by distance and capped at maxCandidates.
+static int reachableMarkers(
+  const KdTree& markerTree,
+  Cloud::ConstPtr markers,
+  const Eigen::Vector3f& expected,
+  const Eigen::Vector3f& semiAxes,
+  size_t maxCandidates,
+  std::vector<int>& candidateIdx,
+  std::vector<float>& candidateSqrDist)
+{
+  std::vector<int> nearestIdx;
+  std::vector<float> nearestSqrDist;
+  markerTree.radiusSearch(eig2pcl(expected), semiAxes.maxCoeff(), nearestIdx, nearestSqrDist);
+
+  candidateIdx.clear();
+  candidateSqrDist.clear();
+  for (size_t i = 0; i < nearestIdx.size(); ++i) {
+    Eigen::Vector3f delta = pcl2eig((*markers)[nearestIdx[i]]) - expected;
+    if (delta.cwiseQuotient(semiAxes).squaredNorm() < 1) {
+      candidateIdx.push_back(nearestIdx[i]);
+      candidateSqrDist.push_back(nearestSqrDist[i]);
+    }
+  }
+
+  // radiusSearch does not guarantee sorted results
+  std::vector<size_t> order(candidateIdx.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return candidateSqrDist[a] < candidateSqrDist[b];
+  });
+  order.resize(std::min(order.size(), maxCandidates));
+  std::vector<int> sortedIdx;
+  std::vector<float> sortedSqrDist;
+  for (size_t i : order) {
+    sortedIdx.push_back(candidateIdx[i]);
+    sortedSqrDist.push_back(candidateSqrDist[i]);
+  }
+  candidateIdx.swap(sortedIdx);
+  candidateSqrDist.swap(sortedSqrDist);
+  return candidateIdx.size();
+}
+
+// Largest distance any marker of a rigid body can move within dt under the
+// dynamics limits: the translation bound (e.g., the largest semi-axis of the
+// motion gate) plus the chord swept by the outermost marker at the maximum
+// angular rate. dt is clamped to the re-initialization timeout.
+static float maxMarkerDisplacement(
+  const DynamicsConfiguration& dynConf,
+  const MarkerConfigurationDescriptor& desc,
+  double dt,
+  float maxTranslation)
+{
+  dt = std::min(dt, dynConf.reinitTimeout);
+  double const maxRate = Eigen::Vector3d(
+    dynConf.maxRollRate, dynConf.maxPitchRate, dynConf.maxYawRate).norm();
+
+  float const radius = desc.radius;
+  double const angle = std::min(maxRate * dt, M_PI);
+  return maxTranslation + 2 * radius * sin(angle / 2);
+}
+
+// Sets the ICP termination criteria of dynConf. With adaptive iterations,
+// the budget grows from icpMinIterations to icpMaxIterations with the
+// predicted motion (relative to the largest possible one) and the residual
+// of the last frame (relative to the acceptance threshold).
+static void configureTrackingICP(
+  ICP& icp,
+  const DynamicsConfiguration& dynConf,
+  float predictedDisplacement,
+  float maxDisplacement,
+  double lastFitnessScore)
+{
+  int maxIterations = dynConf.icpMaxIterations;
+  if (dynConf.icpAdaptiveIterations) {
+    double motion = maxDisplacement > 0 ? predictedDisplacement / maxDisplacement : 1;
+    double residual = lastFitnessScore / dynConf.maxFitnessScore;
+    double effort = std::min(std::max(std::max(motion, residual), 0.0), 1.0);
+    int minIterations = std::min(dynConf.icpMinIterations, dynConf.icpMaxIterations);
+    maxIterations = minIterations + std::ceil(effort * (dynConf.icpMaxIterations - minIterations));
+  }
+  icp.setMaximumIterations(maxIterations);
+  if (dynConf.icpTransformationEpsilon > 0) {
+    icp.setTransformationEpsilon(dynConf.icpTransformationEpsilon);
+  }
+  if (dynConf.icpFitnessEpsilon > 0) {
+    icp.setEuclideanFitnessEpsilon(dynConf.icpFitnessEpsilon);
+  }
+}
+
+// Runs ICP from the yaw templates of the configuration placed at center,
+// each as its own task. Symmetric configurations need fewer seeds.
+// Returns the best fitness score (max double if nothing converged).
+static double alignYawSeeds(
+  TaskScheduler& scheduler,
+  const MarkerConfigurationDescriptor& desc,
+  Cloud::ConstPtr markers,
+  KdTree::Ptr markerTree,
+  const Eigen::Vector3f& center,
+  Eigen::Affine3f& bestTransformation)
+{
+  size_t const numSeeds = desc.yawTemplates.size();
+  std::vector<double> seedErr(numSeeds, std::numeric_limits<double>::max());
+  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>> seedTransformation(numSeeds);
+
+  std::vector<TaskScheduler::Task> tasks;
+  for (size_t i = 0; i < numSeeds; ++i) {
+    tasks.push_back({[&, i]() {
+      ICP icp;
+      icp.setMaximumIterations(5);
+      icp.setInputSource(desc.yawTemplates[i]);
+      icp.setInputTarget(markers);
+      icp.setSearchMethodTarget(markerTree, true);
+
+      Cloud result;
+      Eigen::Matrix4f tryMatrix = getTransformation(
+        center.x(), center.y(), center.z(), 0, 0, 0).matrix();
+      icp.align(result, tryMatrix);
+      if (icp.hasConverged()) {
+        // the template is already rotated by the seed yaw
+        Eigen::Affine3f seedYaw(Eigen::AngleAxisf(desc.seedYaws[i], Eigen::Vector3f::UnitZ()));
+        seedErr[i] = icp.getFitnessScore();
+        seedTransformation[i] = icp.getFinalTransformation() * seedYaw.matrix();
+      }
+    }, 1.0});
+  }
+  scheduler.run(tasks);
+
+  double bestErr = std::numeric_limits<double>::max();
+  for (size_t i = 0; i < numSeeds; ++i) {
+    if (seedErr[i] < bestErr) {
+      bestErr = seedErr[i];
+      bestTransformation = seedTransformation[i];
+    }
+  }
+  return bestErr;
+}
+
+// Searches the pose of a multi-marker rigid body close to nominalCenter, by
+// running ICP from several yaw guesses about the centroid of the nearest
+// markers. On failure, returns false and the reason in error.
+static bool searchPose(
+  TaskScheduler& scheduler,
+  const MarkerConfigurationDescriptor& desc,
+  Cloud::ConstPtr markers,
+  KdTree::Ptr markerTree,
+  const Eigen::Vector3f& nominalCenter,
+  float maxDeviation,
+  double maxFitnessScore,
+  Eigen::Affine3f& transformation,
+  std::string& error)
+{
+  size_t const rbNpts = desc.numMarkers;
+  std::vector<int> nearestIdx(rbNpts);
+  std::vector<float> nearestSqrDist(rbNpts);
+  int nFound = markerTree->nearestKSearch(
+    eig2pcl(nominalCenter), rbNpts, nearestIdx, nearestSqrDist);
+
+  if (nFound < 0 || size_t(nFound) < rbNpts) {
+    std::stringstream sstr;
+    sstr << "only " << nFound << " neighbors found (need " << rbNpts << ")";
+    error = sstr.str();
+    return false;
+  }
+
+  // only try to fit the rigid body if the k nearest neighbors
+  // are reasonably close to the nominal rigid body position
+  Eigen::Vector3f actualCenter(0, 0, 0);
+  for (size_t i = 0; i < rbNpts; ++i) {
+    actualCenter += pcl2eig((*markers)[nearestIdx[i]]);
+  }
+  actualCenter /= rbNpts;
+  if ((actualCenter - nominalCenter).norm() > maxDeviation) {
+    std::stringstream sstr;
+    sstr << "nearest neighbors are centered at " << actualCenter.transpose()
+         << " instead of " << nominalCenter.transpose();
+    error = sstr.str();
+    return false;
+  }
+
+  // try ICP with guesses of many different yaws about knn centroid
+  double bestErr = alignYawSeeds(scheduler, desc, markers, markerTree,
+    actualCenter, transformation);
+  if (bestErr >= maxFitnessScore) {
+    error = "initialize did not succeed (fitness too low)";
+    return false;
+  }
+  return true;
+}
+
+// Checks the translation from last to current (dt seconds apart) against
+// the dynamics limits and the fitness score against maxFitnessScore, whose
+// meaning depends on how the estimate was obtained. Violations are described
+// in violations.
+static bool withinTranslationDynamics(
+  const DynamicsConfiguration& dynConf,
+  const Eigen::Vector3f& last,
+  const Eigen::Vector3f& current,
+  double dt,
+  double fitnessScore,
+  double maxFitnessScore,
+  std::stringstream& violations)
+{
+  Eigen::Vector3f const v = (current - last) / dt;
+  bool valid = true;
+  if (fabs(v.x()) >= dynConf.maxXVelocity) {
+    violations << "vx: " << v.x() << " >= " << dynConf.maxXVelocity << std::endl;
+    valid = false;
+  }
+  if (fabs(v.y()) >= dynConf.maxYVelocity) {
+    violations << "vy: " << v.y() << " >= " << dynConf.maxYVelocity << std::endl;
+    valid = false;
+  }
+  if (fabs(v.z()) >= dynConf.maxZVelocity) {
+    violations << "vz: " << v.z() << " >= " << dynConf.maxZVelocity << std::endl;
+    valid = false;
+  }
+  if (fitnessScore >= maxFitnessScore) {
+    violations << "fitness: " << fitnessScore << " >= " << maxFitnessScore << std::endl;
+    valid = false;
+  }
+  return valid;
+}
+
+// Same as above for the ICP fitness score, and additionally checks the
+// change of orientation and the attitude.
+static bool withinDynamics(
+  const DynamicsConfiguration& dynConf,
+  const Eigen::Affine3f& last,
+  const Eigen::Affine3f& current,
+  double dt,
+  double fitnessScore,
+  std::stringstream& violations)
+{
+  bool valid = withinTranslationDynamics(dynConf, last.translation(), current.translation(),
+    dt, fitnessScore, dynConf.maxFitnessScore, violations);
+
+  float x, y, z, roll, pitch, yaw;
+  getTranslationAndEulerAngles(current, x, y, z, roll, pitch, yaw);
+  float last_x, last_y, last_z, last_roll, last_pitch, last_yaw;
+  getTranslationAndEulerAngles(last, last_x, last_y, last_z, last_roll, last_pitch, last_yaw);
+
+  float wroll = deltaAngle(roll, last_roll) / dt;
+  float wpitch = deltaAngle(pitch, last_pitch) / dt;
+  float wyaw = deltaAngle(yaw, last_yaw) / dt;
+
+  if (fabs(wroll) >= dynConf.maxRollRate) {
+    violations << "wroll: " << wroll << " >= " << dynConf.maxRollRate << std::endl;
+    valid = false;
+  }
+  if (fabs(wpitch) >= dynConf.maxPitchRate) {
+    violations << "wpitch: " << wpitch << " >= " << dynConf.maxPitchRate << std::endl;
+    valid = false;
+  }
+  if (fabs(wyaw) >= dynConf.maxYawRate) {
+    violations << "wyaw: " << wyaw << " >= " << dynConf.maxYawRate << std::endl;
+    valid = false;
+  }
+  if (fabs(roll) >= dynConf.maxRoll) {
+    violations << "roll: " << roll << " >= " << dynConf.maxRoll << std::endl;
+    valid = false;
+  }
+  if (fabs(pitch) >= dynConf.maxPitch) {
+    violations << "pitch: " << pitch << " >= " << dynConf.maxPitch << std::endl;
+    valid = false;
+  }
+  return valid;
+}
+
+// Position-only estimate of a multi-marker body from the centroid of its
+// markers, which does not depend on the orientation: the markers nearest to
+// the expected marker centroid are assigned to the body if all of them are
+// within reach, and the center is their centroid minus the marker centroid
+// of the configuration at the last known orientation. The reported center
+// is therefore off by the rotation since acquisition applied to the offset
+// between body origin and marker centroid (at most twice its length); the
+// marker centroid itself is exact. Occluded markers shift the centroid, so
+// all markers have to be visible. The fitness score is the deviation of the
+// spread (mean squared distance to the centroid, m^2) of the assigned markers
+// from the configuration's, which does not depend on the orientation either;
+// it is checked against maxSpreadDeviation. Returns false if not all markers
+// were in reach; matchedIdx is sorted.
+static bool centroidEstimate(
+  const KdTree& markerTree,
+  Cloud::ConstPtr markers,
+  const MarkerConfigurationDescriptor& desc,
+  const Eigen::Affine3f& last,
+  const Eigen::Vector3f& predictedCenter,
+  float maxTranslation,
+  Eigen::Affine3f& result,
+  double& fitnessScore,
+  std::vector<int>& matchedIdx)
+{
+  Eigen::Vector3f const centroidOffset = last.linear() * desc.centroid;
+  Eigen::Vector3f const expectedCentroid = predictedCenter + centroidOffset;
+  float const reach = maxTranslation + desc.centroidRadius + 2 * desc.centroid.norm();
+
+  std::vector<float> sqrDist;
+  if (markerTree.nearestKSearch(eig2pcl(expectedCentroid), desc.numMarkers, matchedIdx, sqrDist) < 0
+      || matchedIdx.size() < desc.numMarkers
+      || sqrDist.back() > reach * reach) {
+    return false;
+  }
+
+  Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+  for (int idx : matchedIdx) {
+    centroid += pcl2eig((*markers)[idx]);
+  }
+  centroid /= desc.numMarkers;
+  double spread = 0;
+  for (int idx : matchedIdx) {
+    spread += (pcl2eig((*markers)[idx]) - centroid).squaredNorm();
+  }
+  spread /= desc.numMarkers;
+  fitnessScore = std::fabs(spread - desc.spread);
+
+  result = last;
+  result.translation() = centroid - centroidOffset;
+  std::sort(matchedIdx.begin(), matchedIdx.end());
+  return true;
+}
+
+// Conflict-based search over the group assignment of data, i.e., every
+// agent gets at most one of its task sets and no task is used twice.
+// Returns the cheapest conflict-free node, or the last one expanded if
+// there is none.
+static HighLevelNode solveGroupAssignment(const std::set<CBS_InputData>& data)
+{
+  CBS_Assignment<std::string, std::string> CBS_assignment;
+  for (const auto& d : data) {
+    CBS_assignment.setCost(d.agent, d.taskSet, d.cost);
+  }
+
+  HighLevelNode start;
+  start.id = 0;
+  start.cost = CBS_assignment.solve(start.solution);
+  typename boost::heap::d_ary_heap<HighLevelNode, boost::heap::arity<2>,
+                                    boost::heap::mutable_<true> >
+      open;
+
+  auto handle = open.push(start);
+  (*handle).handle = handle;
+
+  int id = 1;
+  HighLevelNode P;
+  while (!open.empty()) {
+    P = open.top();
+    open.pop();
+
+    std::string conflict_task;
+    if (!getFirstConflict(P.solution, conflict_task)) {
+      break;
+    }
+    std::set<std::set<Constraint>> new_constraints;
+    createConstraintsFromConflict(P.solution, conflict_task, new_constraints);
+    for (const auto& new_constraint_set : new_constraints) {
+      HighLevelNode newNode;
+      LowLevelSearch(new_constraint_set, data, P, newNode, id);
+      auto handle = open.push(newNode);
+      (*handle).handle = handle;
+    }
+  }
+  return P;
+}
+
+namespace {
+
+  // One way to explain a tracked rigid body in the current frame: a single
+  // marker for single-marker bodies, a registered pose otherwise.
+  struct TrackingCandidate
+  {
+    // markers the body takes, sorted
+    std::vector<int> markers;
+    long cost;
+    Eigen::Affine3f transformation;
+    double fitnessScore;
+  };
+
+  std::set<std::string> taskSet(const TrackingCandidate& candidate)
+  {
+    std::set<std::string> result;
+    for (int idx : candidate.markers) {
+      result.insert(std::to_string(idx));
+    }
+    return result;
+  }
+
+  size_t findRoot(std::vector<size_t>& parent, size_t i)
+  {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  }
+
+} // anonymous namespace
+
+// the core cloud of a marker configuration
+static Cloud::ConstPtr markerPoints(const MarkerConfiguration& markers)
+{
+#ifdef LIBRIGIDBODYTRACKER_WITH_PCL
+  return fromPCL(*markers);
+#else
+  return markers;
+#endif
+}
+
 /////////////////////////////////////////////////////////////
 
 RigidBody::RigidBody(
@@ -51,9 +495,18 @@ RigidBody::RigidBody(
   , m_lastTransformation(initialTransformation)
   , m_hasOrientation(false)
   , m_initialTransformation(initialTransformation)
+  , m_velocity(Eigen::Vector3f::Zero())
   , m_lastValidTransform()
   , m_lastTransformationValid(false)
   , m_name(name)
+  , m_updateCost(0)
+  , m_initialized(false)
+  , m_fitnessScore(0)
+  , m_icpIterations(0)
+  , m_trackingMode(PositionMode)
+  , m_positionOnly(false)
+  , m_initAttempts(0)
+  , m_nextInitAttempt(0)
 {
 }
 
@@ -81,30 +534,67 @@ RigidBodyTracker::RigidBodyTracker(
   : m_markerConfigurations(markerConfigurations)
   , m_dynamicsConfigurations(dynamicsConfigurations)
   , m_rigidBodies(rigidBodies)
-  , m_trackPositionOnly(false)
-  , m_trackingMode(PositionMode)
-  , m_initialized(false)
-  , m_init_attempts(0)
+  , m_frame(0)
+  , m_maxInitializationsPerFrame(std::numeric_limits<size_t>::max())
   , m_logWarn()
+  , m_scheduler(new TaskScheduler(1))
+  , m_inputCloud(new Cloud)
 {
-  for (const RigidBody& rigidBody : m_rigidBodies) {
-    Cloud::Ptr &rbMarkers = m_markerConfigurations[rigidBody.m_markerConfigurationIdx];
-    size_t const rbNpts = rbMarkers->size();
-    // std::cout <<" rbNpts: "<<rbNpts << std::endl;
+  for (const auto& markerConfiguration : m_markerConfigurations) {
+    m_markerDescriptors.push_back(describeMarkerConfiguration(markerPoints(markerConfiguration)));
+  }
+  for (RigidBody& rigidBody : m_rigidBodies) {
+    resetPoseHistory(rigidBody);
+  }
+  updateTrackingMode();
+}
 
-    if (rbNpts == 1) {
-      m_trackPositionOnly = true;
-    }
-    else if(rbNpts > 1){
-      m_trackingMode = PoseMode;
+RigidBodyTracker::~RigidBodyTracker()
+{
+  m_latestFrameWorker.reset();
+  if (m_lastAsyncUpdate.valid()) {
+    m_lastAsyncUpdate.wait();
+  }
+  // a running search writes into m_hypotheses
+  m_reacquisitionWorker.reset();
+}
+
+void RigidBodyTracker::updateTrackingMode()
+{
+  // bodies with a single marker are tracked by assignment, others by
+  // registration of their marker configuration, unless only their position
+  // is needed
+  for (RigidBody& rigidBody : m_rigidBodies) {
+    size_t const rbNpts = m_markerDescriptors[rigidBody.m_markerConfigurationIdx]->numMarkers;
+    if (rbNpts <= 1) {
+      rigidBody.m_trackingMode = PositionMode;
+    } else {
+      rigidBody.m_trackingMode = rigidBody.m_positionOnly ? CentroidMode : PoseMode;
     }
   }
 
-  if (m_trackPositionOnly && m_trackingMode == PoseMode) {
-    // throw std::runtime_error("Cannot use single-marker and multi-marker configurations simultaneously.");
-    m_trackingMode = HybridMode;
+  // compute the distance between the closest 2 rigidBodies in the nominal configuration
+  // we will use this value to limit allowed deviation from nominal positions
+  size_t const numRigidBodies = m_rigidBodies.size();
+  float closest = std::numeric_limits<float>::max();
+  for (size_t i = 0; i < numRigidBodies; ++i) {
+    auto pi = m_rigidBodies[i].initialCenter();
+    for (size_t j = i + 1; j < numRigidBodies; ++j) {
+      float dist = (pi - m_rigidBodies[j].initialCenter()).norm();
+      closest = std::min(closest, dist);
+    }
   }
+  m_maxInitialDeviation = closest / 3;
+}
 
+void RigidBodyTracker::discardHypotheses()
+{
+  if (m_reacquisitionWorker) {
+    // searches in flight would report for the wrong index
+    m_reacquisitionWorker.reset(new ReacquisitionWorker);
+  }
+  std::lock_guard<std::mutex> lock(m_hypothesesMutex);
+  m_hypotheses.clear();
 }
 
 
@@ -115,308 +605,534 @@ void RigidBodyTracker::update(Cloud::Ptr pointCloud)
 void RigidBodyTracker::update(std::chrono::high_resolution_clock::time_point time,
   Cloud::Ptr pointCloud, std::string inputPath)
 {
-  // std::cout << "Current tracking mode: " << m_trackingMode << std::endl;
-  if (m_trackingMode == PositionMode) {
-    updatePosition(time, pointCloud);
-  } else if (m_trackingMode == PoseMode) {
-    updatePose(time, pointCloud);
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  m_inputIds.clear();
+  updateLocked(time, pointCloud, inputPath);
+}
+
+void RigidBodyTracker::update(std::chrono::high_resolution_clock::time_point stamp,
+  const MarkerView& markers)
+{
+  static_assert(sizeof(Point) == 3 * sizeof(float), "Point must be a float triplet");
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  Cloud::ConstPtr cloud;
+  if (markers.stride == sizeof(Point)) {
+    cloud = Cloud::view(reinterpret_cast<const Point*>(markers.data), markers.count);
+  } else {
+    m_inputCloud->resize(markers.count);
+    for (size_t i = 0; i < markers.count; ++i) {
+      const float* p = markers.marker(i);
+      (*m_inputCloud)[i] = Point(p[0], p[1], p[2]);
+    }
+    cloud = m_inputCloud;
   }
-  else if (m_trackingMode == HybridMode){
-    updateHybrid(time, pointCloud);
+  if (markers.ids) {
+    m_inputIds.assign(markers.ids, markers.ids + markers.count);
+  } else {
+    m_inputIds.clear();
   }
-  m_inputPath = inputPath;
+  updateLocked(stamp, cloud, "");
 }
 
-const std::vector<RigidBody>& RigidBodyTracker::rigidBodies() const
+bool RigidBodyTracker::updateFromChannel(MarkerChannelConsumer& channel, bool newestOnly)
 {
-  return m_rigidBodies;
+  size_t skipped = 0;
+  while (newestOnly && channel.pending() > 1) {
+    channel.release();
+    ++skipped;
+  }
+  std::chrono::high_resolution_clock::time_point stamp;
+  MarkerView markers(nullptr, 0);
+  if (!channel.peek(stamp, markers)) {
+    return false;
+  }
+  update(stamp, markers);
+  channel.release();
+
+  if (newestOnly) {
+    std::lock_guard<std::mutex> lock(m_ingestMutex);
+    m_ingestStatistics.submittedFrames += skipped + 1;
+    m_ingestStatistics.skippedFrames += skipped;
+    ++m_ingestStatistics.processedFrames;
+  }
+  return true;
 }
 
-void RigidBodyTracker::setLogWarningCallback(
-  std::function<void(const std::string&)> logWarn)
+void RigidBodyTracker::submitLatest(std::chrono::high_resolution_clock::time_point stamp,
+  PointCloud::Ptr pointCloud)
 {
-  m_logWarn = logWarn;
+  if (!m_latestFrameWorker) {
+    m_latestFrameWorker.reset(new LatestFrameWorker);
+  }
+  bool skipped = m_latestFrameWorker->submit([this, stamp, pointCloud]() {
+    {
+      std::lock_guard<std::mutex> lock(m_updateMutex);
+      m_inputIds.clear();
+      updateLocked(stamp, pointCloud, "");
+    }
+    std::lock_guard<std::mutex> lock(m_ingestMutex);
+    ++m_ingestStatistics.processedFrames;
+  });
+
+  std::lock_guard<std::mutex> lock(m_ingestMutex);
+  ++m_ingestStatistics.submittedFrames;
+  if (skipped) {
+    ++m_ingestStatistics.skippedFrames;
+  }
 }
 
-bool RigidBodyTracker::initializePose(Cloud::ConstPtr markersConst)
+bool RigidBodyTracker::backpressure() const
 {
-  if (markersConst->size() == 0) {
-    return false;
+  return m_latestFrameWorker && m_latestFrameWorker->pending();
+}
+
+void RigidBodyTracker::waitLatest()
+{
+  if (m_latestFrameWorker) {
+    m_latestFrameWorker->wait();
   }
+}
 
-  // we need to mutate the cloud by deleting points
-  // once they are assigned to an rigid body
-  Cloud::Ptr markers(new Cloud(*markersConst));
+IngestStatistics RigidBodyTracker::ingestStatistics() const
+{
+  std::lock_guard<std::mutex> lock(m_ingestMutex);
+  return m_ingestStatistics;
+}
 
-  size_t const numRigidBodies = m_rigidBodies.size();
+std::shared_future<RigidBodyTracker::FrameResult> RigidBodyTracker::updateAsync(
+  std::chrono::high_resolution_clock::time_point stamp,
+  Cloud::Ptr pointCloud)
+{
+  // frames are processed strictly in the order they were submitted
+  std::shared_future<FrameResult> previous = m_lastAsyncUpdate;
+  m_lastAsyncUpdate = std::async(std::launch::async, [this, stamp, pointCloud, previous]() {
+    if (previous.valid()) {
+      previous.wait();
+    }
+    std::lock_guard<std::mutex> lock(m_updateMutex);
+    m_inputIds.clear();
+    updateLocked(stamp, pointCloud, "");
+    FrameResult result;
+    result.stamp = stamp;
+    result.rigidBodies = m_rigidBodies;
+    return result;
+  }).share();
+  return m_lastAsyncUpdate;
+}
 
-  ICP icp;
-  icp.setMaximumIterations(5);
-  icp.setInputTarget(markers);
+void RigidBodyTracker::updateLocked(std::chrono::high_resolution_clock::time_point time,
+  Cloud::ConstPtr pointCloud, const std::string& inputPath)
+{
+  m_notified.assign(m_rigidBodies.size(), false);
+  for (auto& rigidBody : m_rigidBodies) {
+    rigidBody.m_icpIterations = 0;
+  }
+  pointCloud = prefilter(time, pointCloud);
 
-  // prepare for knn query
-  std::vector<int> nearestIdx;
-  std::vector<float> nearestSqrDist;
-  std::vector<int> rbTakePts;
-  pcl::KdTreeFLANN<Point> kdtree;
-  kdtree.setInputCloud(markers);
+  updateRigidBodies(time, pointCloud);
+  m_inputPath = inputPath;
+  ++m_frame;
 
-  // compute the distance between the closest 2 rigidBodies in the nominal configuration
-  // we will use this value to limit allowed deviation from nominal positions
-  float closest = std::numeric_limits<float>::max();
-  for (int i = 0; i < numRigidBodies; ++i) {
-    auto pi = m_rigidBodies[i].initialCenter();
-    for (int j = i + 1; j < numRigidBodies; ++j) {
-      float dist = (pi - m_rigidBodies[j].initialCenter()).norm();
-      closest = std::min(closest, dist);
+  for (const auto& rigidBody : m_rigidBodies) {
+    if (rigidBody.m_icpIterations > 0) {
+      if (m_icpIterationHistogram.size() <= rigidBody.m_icpIterations) {
+        m_icpIterationHistogram.resize(rigidBody.m_icpIterations + 1, 0);
+      }
+      ++m_icpIterationHistogram[rigidBody.m_icpIterations];
     }
   }
-  float const max_deviation = closest / 3;
-
-  //printf("Rigid Body tracker: limiting distance from nominal position "
-  //  "to %f meters\n", max_deviation);
 
-  bool allFitsGood = true;
-  for (int iRb = 0; iRb < numRigidBodies; ++iRb) {
-    RigidBody& rigidBody = m_rigidBodies[iRb];
-    Cloud::Ptr &rbMarkers =
-      m_markerConfigurations[rigidBody.m_markerConfigurationIdx];
-    icp.setInputSource(rbMarkers);
+  for (size_t iRb = 0; iRb < m_rigidBodies.size(); ++iRb) {
+    notifyRigidBody(iRb);
+  }
 
-    // find the points nearest to the rigidBodie's nominal position
-    // (initial pos was loaded into lastTransformation from config file)
-    size_t const rbNpts = rbMarkers->size();
-    nearestIdx.resize(rbNpts);
-    nearestSqrDist.resize(rbNpts);
-    auto nominalCenter = eig2pcl(rigidBody.initialCenter());
-    int nFound = kdtree.nearestKSearch(
-      nominalCenter, rbNpts, nearestIdx, nearestSqrDist);
-
-    if (nFound < rbNpts) {
-      std::stringstream sstr;
-      sstr << "error: only " << nFound
-           << " neighbors found for rigid body " << rigidBody.name()
-           << " (need " << rbNpts << ")";
-      logWarn(sstr.str());
-      allFitsGood = false;
-      continue;
-    }
+  if (m_posePublisher) {
+    m_posePublisher->publish(time, m_rigidBodies);
+  }
+}
 
-    // only try to fit the rigid body if the k nearest neighbors
-    // are reasonably close to the nominal rigid body position
-    Eigen::Vector3f actualCenter(0, 0, 0);
-    for (int i = 0; i < rbNpts; ++i) {
-      actualCenter += pcl2eig((*markers)[nearestIdx[i]]);
-    }
-    actualCenter /= rbNpts;
-    if ((actualCenter - pcl2eig(nominalCenter)).norm() > max_deviation) {
-      std::stringstream sstr;
-      sstr << "error: nearest neighbors of rigid body " << rigidBody.name()
-           << " are centered at " << actualCenter
-           << " instead of " << nominalCenter;
-      logWarn(sstr.str());
-      allFitsGood = false;
-      continue;
-    }
+const std::vector<RigidBody>& RigidBodyTracker::rigidBodies() const
+{
+  return m_rigidBodies;
+}
 
-    // try ICP with guesses of many different yaws about knn centroid
-    Cloud result;
-    static int const N_YAW = 20;
-    double bestErr = std::numeric_limits<double>::max();
-    Eigen::Affine3f bestTransformation;
-    for (int i = 0; i < N_YAW; ++i) {
-      float yaw = i * (2 * M_PI / N_YAW);
-      Eigen::Matrix4f tryMatrix = pcl::getTransformation(
-        actualCenter.x(), actualCenter.y(), actualCenter.z(),
-        0, 0, yaw).matrix();
-      icp.align(result, tryMatrix);
-      if (icp.hasConverged()) {
-        double err = icp.getFitnessScore();
-        if (err < bestErr) {
-          bestErr = err;
-          bestTransformation = icp.getFinalTransformation();
-        }
-      }
-    }
+size_t RigidBodyTracker::addMarkerConfiguration(const MarkerConfiguration& markerConfiguration)
+{
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  m_markerConfigurations.push_back(markerConfiguration);
+  m_markerDescriptors.push_back(describeMarkerConfiguration(markerPoints(markerConfiguration)));
+  return m_markerConfigurations.size() - 1;
+}
 
-    const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
-    if (bestErr >= dynConf.maxFitnessScore) {
-      std::stringstream sstr;
-      sstr << "Initialize did not succeed (fitness too low) "
-           << " for rigidBody " << rigidBody.name();
-      logWarn(sstr.str());
-      allFitsGood = false;
-      continue;
-    }
+size_t RigidBodyTracker::addDynamicsConfiguration(const DynamicsConfiguration& dynamicsConfiguration)
+{
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  m_dynamicsConfigurations.push_back(dynamicsConfiguration);
+  return m_dynamicsConfigurations.size() - 1;
+}
 
-    // if the fit was good, this rigid body "takes" the markers, and they become
-    // unavailable to all other rigidBodies so we don't double-assign markers
-    // (TODO: this is so greedy... do we need a more global approach?)
-    rigidBody.m_lastTransformation = bestTransformation;
-    // remove highest indices first
-    std::sort(rbTakePts.rbegin(), rbTakePts.rend());
-    for (int idx : rbTakePts) {
-      markers->erase(markers->begin() + idx);
-    }
-    // update search structures after deleting markers
-    icp.setInputTarget(markers);
-    kdtree.setInputCloud(markers);
+size_t RigidBodyTracker::addRigidBody(const RigidBody& rigidBody)
+{
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  if (rigidBody.m_markerConfigurationIdx >= m_markerConfigurations.size()
+      || rigidBody.m_dynamicsConfigurationIdx >= m_dynamicsConfigurations.size()) {
+    throw std::runtime_error("RigidBodyTracker: unknown configuration of rigid body " + rigidBody.name());
   }
-
-  ++m_init_attempts;
-  return allFitsGood;
+  // indices of the other bodies do not change, so their state (including
+  // pending background searches) is kept
+  m_rigidBodies.push_back(rigidBody);
+  // a copy of a tracked body must not share its history
+  resetPoseHistory(m_rigidBodies.back());
+  updateTrackingMode();
+  return m_rigidBodies.size() - 1;
 }
 
-void RigidBodyTracker::updatePose(std::chrono::high_resolution_clock::time_point stamp,
-  Cloud::ConstPtr markers)
+void RigidBodyTracker::removeRigidBody(size_t rigidBodyIdx)
 {
-  if (markers->empty()) {
-    for (auto& rigidBody : m_rigidBodies) {
-      rigidBody.m_lastTransformationValid = false;
-    }
-    return;
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  if (rigidBodyIdx >= m_rigidBodies.size()) {
+    throw std::runtime_error("RigidBodyTracker: rigid body index out of range.");
   }
+  m_rigidBodies.erase(m_rigidBodies.begin() + rigidBodyIdx);
+  updateTrackingMode();
+  discardHypotheses();
+}
 
-  m_initialized = m_initialized || initializePose(markers);
-  if (!m_initialized) {
-    logWarn(
-      "rigid body tracker initialization failed - "
-      "check that position is correct, all markers are visible, "
-      "and marker configuration matches config file");
-    // Doesn't make too much sense to continue here - lets wait to be fully initialized
-    return;
+void RigidBodyTracker::setPositionOnly(size_t rigidBodyIdx, bool positionOnly)
+{
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  if (rigidBodyIdx >= m_rigidBodies.size()) {
+    throw std::runtime_error("RigidBodyTracker: rigid body index out of range.");
   }
+  m_rigidBodies[rigidBodyIdx].m_positionOnly = positionOnly;
+  updateTrackingMode();
+}
 
-  ICP icp;
-  // pcl::registration::TransformationEstimationLM<Point, Point>::Ptr trans(new pcl::registration::TransformationEstimationLM<Point, Point>);
-  // pcl::registration::TransformationEstimation2D<Point, Point>::Ptr trans(new pcl::registration::TransformationEstimation2D<Point, Point>);
-  // pcl::registration::TransformationEstimation3DYaw<Point, Point>::Ptr trans(new pcl::registration::TransformationEstimation3DYaw<Point, Point>);
-  // icp.setTransformationEstimation(trans);
-
+// "LRBTSTA" followed by a zero byte
+static const char StateMagic[8] = {'L', 'R', 'B', 'T', 'S', 'T', 'A', 0};
+// bump whenever the layout below changes
+static const uint32_t StateVersion = 2;
 
-  // // Set the maximum number of iterations (criterion 1)
-  icp.setMaximumIterations(5);
-  // // Set the transformation epsilon (criterion 2)
-  // icp.setTransformationEpsilon(1e-8);
-  // // Set the euclidean distance difference epsilon (criterion 3)
-  // icp.setEuclideanFitnessEpsilon(1);
+static void writeStamp(BinaryWriter& w, std::chrono::high_resolution_clock::time_point stamp)
+{
+  w.write<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+    stamp.time_since_epoch()).count());
+}
 
-  icp.setInputTarget(markers);
+static bool readStamp(BinaryReader& r, std::chrono::high_resolution_clock::time_point& stamp)
+{
+  int64_t ns;
+  if (!r.read(ns)) {
+    return false;
+  }
+  stamp = std::chrono::high_resolution_clock::time_point(
+    std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+      std::chrono::nanoseconds(ns)));
+  return true;
+}
 
-  for (auto& rigidBody : m_rigidBodies) {
-    rigidBody.m_lastTransformationValid = false;
+static void writeVector(BinaryWriter& w, const Eigen::Vector3f& v)
+{
+  w.write<float>(v.x());
+  w.write<float>(v.y());
+  w.write<float>(v.z());
+}
 
-    std::chrono::duration<double> elapsedSeconds = stamp-rigidBody.m_lastValidTransform;
-    double dt = elapsedSeconds.count();
+static bool readVector(BinaryReader& r, Eigen::Vector3f& v)
+{
+  return r.read(v.x()) && r.read(v.y()) && r.read(v.z());
+}
 
-    // Set the max correspondence distance
-    const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
-    float maxV = dynConf.maxXVelocity;
-    icp.setMaxCorrespondenceDistance(maxV * dt);
-    // ROS_INFO("max: %f", maxV * dt);
+std::vector<uint8_t> RigidBodyTracker::saveState() const
+{
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  BinaryWriter w;
+  for (char c : StateMagic) {
+    w.write(c);
+  }
+  w.write(StateVersion);
+  w.write<uint32_t>(m_rigidBodies.size());
+  for (const RigidBody& rigidBody : m_rigidBodies) {
+    w.writeString(rigidBody.m_name);
+    // the pose only means something for the same marker configuration
+    const MarkerConfigurationDescriptor& desc = *m_markerDescriptors[rigidBody.m_markerConfigurationIdx];
+    w.write<uint32_t>(desc.numMarkers);
+    for (const Point& p : *desc.points) {
+      writeVector(w, pcl2eig(p));
+    }
+    const Eigen::Matrix4f& m = rigidBody.m_lastTransformation.matrix();
+    for (int i = 0; i < 16; ++i) {
+      w.write<float>(m.data()[i]);
+    }
+    w.write<uint8_t>(rigidBody.m_hasOrientation);
+    w.write<uint8_t>(rigidBody.m_positionOnly);
+    writeVector(w, rigidBody.m_velocity);
+    writeStamp(w, rigidBody.m_lastValidTransform);
+    w.write<uint8_t>(rigidBody.m_lastTransformationValid);
+    w.write<uint8_t>(rigidBody.m_initialized);
+    w.write<double>(rigidBody.m_fitnessScore);
+    w.write<double>(rigidBody.m_updateCost);
+    // the backoff is relative to the frame counter of this tracker
+    w.write<uint32_t>(rigidBody.m_initAttempts);
+    w.write<uint32_t>(rigidBody.m_nextInitAttempt > m_frame ? rigidBody.m_nextInitAttempt - m_frame : 0);
+
+    const MotionFilter& filter = rigidBody.m_motionFilter;
+    w.write<uint8_t>(filter.m_initialized);
+    writeStamp(w, filter.m_stamp);
+    writeVector(w, filter.m_position);
+    writeVector(w, filter.m_velocity);
+    writeVector(w, filter.m_varPosition);
+    writeVector(w, filter.m_cov);
+    writeVector(w, filter.m_varVelocity);
+  }
+  const std::string& buffer = w.buffer();
+  return std::vector<uint8_t>(buffer.begin(), buffer.end());
+}
 
-    // Update input source
-    icp.setInputSource(m_markerConfigurations[rigidBody.m_markerConfigurationIdx]);
+size_t RigidBodyTracker::restoreState(const std::vector<uint8_t>& state)
+{
+  BinaryReader r(state.data(), state.size());
+  char magic[sizeof(StateMagic)];
+  for (char& c : magic) {
+    if (!r.read(c)) {
+      throw std::runtime_error("RigidBodyTracker: truncated state.");
+    }
+  }
+  uint32_t version;
+  if (std::memcmp(magic, StateMagic, sizeof(StateMagic)) != 0
+      || !r.read(version) || version != StateVersion) {
+    throw std::runtime_error("RigidBodyTracker: unknown state format.");
+  }
 
-    // Perform the alignment
-    Cloud result;
-    // auto deltaPos = Eigen::Translation3f(dt * rigidBody.m_velocity);
-    // auto predictTransform = deltaPos * rigidBody.m_lastTransformation;
-    auto predictTransform = rigidBody.m_lastTransformation;
-    icp.align(result, predictTransform.matrix());
-    if (!icp.hasConverged()) {
-      // ros::Time t = ros::Time::now();
-      // ROS_INFO("ICP did not converge %d.%d", t.sec, t.nsec);
-      std::stringstream sstr;
-      sstr << "ICP did not converge!"
-           << " for rigidBody " << rigidBody.name();
-      logWarn(sstr.str());
-      continue;
+  // parse everything before touching any rigid body
+  uint32_t count;
+  if (!r.read(count)) {
+    throw std::runtime_error("RigidBodyTracker: truncated state.");
+  }
+  std::vector<std::pair<std::string, RigidBody>> restored;
+  std::vector<std::vector<Eigen::Vector3f>> restoredMarkers;
+  for (uint32_t i = 0; i < count; ++i) {
+    RigidBody rigidBody(0, 0, Eigen::Affine3f::Identity(), "");
+    Eigen::Matrix4f m;
+    uint32_t numMarkers;
+    uint8_t hasOrientation, positionOnly, valid, initialized, filterInitialized;
+    uint32_t initAttempts, nextInitAttempt;
+    MotionFilter& filter = rigidBody.m_motionFilter;
+    bool ok = r.readString(rigidBody.m_name) && r.read(numMarkers)
+      // a corrupt count must not allocate more than the blob could hold
+      && numMarkers <= state.size();
+    std::vector<Eigen::Vector3f> markers(ok ? numMarkers : 0);
+    for (size_t j = 0; j < markers.size() && ok; ++j) {
+      ok = readVector(r, markers[j]);
+    }
+    for (int j = 0; j < 16 && ok; ++j) {
+      ok = r.read(m.data()[j]);
+    }
+    ok = ok
+      && r.read(hasOrientation)
+      && r.read(positionOnly)
+      && readVector(r, rigidBody.m_velocity)
+      && readStamp(r, rigidBody.m_lastValidTransform)
+      && r.read(valid)
+      && r.read(initialized)
+      && r.read(rigidBody.m_fitnessScore)
+      && r.read(rigidBody.m_updateCost)
+      && r.read(initAttempts)
+      && r.read(nextInitAttempt)
+      && r.read(filterInitialized)
+      && readStamp(r, filter.m_stamp)
+      && readVector(r, filter.m_position)
+      && readVector(r, filter.m_velocity)
+      && readVector(r, filter.m_varPosition)
+      && readVector(r, filter.m_cov)
+      && readVector(r, filter.m_varVelocity);
+    if (!ok) {
+      throw std::runtime_error("RigidBodyTracker: truncated state.");
     }
+    rigidBody.m_lastTransformation.matrix() = m;
+    rigidBody.m_hasOrientation = hasOrientation;
+    rigidBody.m_positionOnly = positionOnly;
+    rigidBody.m_lastTransformationValid = valid;
+    rigidBody.m_initialized = initialized;
+    rigidBody.m_initAttempts = initAttempts;
+    rigidBody.m_nextInitAttempt = nextInitAttempt;
+    filter.m_initialized = filterInitialized;
+    restored.emplace_back(rigidBody.m_name, rigidBody);
+    restoredMarkers.push_back(markers);
+  }
+  if (!r.atEnd()) {
+    throw std::runtime_error("RigidBodyTracker: trailing data in state.");
+  }
 
-    // Obtain the transformation that aligned cloud_source to cloud_source_registered
-    Eigen::Matrix4f transformation = icp.getFinalTransformation();
-
-    Eigen::Affine3f tROTA(transformation);
-    float x, y, z, roll, pitch, yaw;
-    pcl::getTranslationAndEulerAngles(tROTA, x, y, z, roll, pitch, yaw);
-
-    // Compute changes:
-    float last_x, last_y, last_z, last_roll, last_pitch, last_yaw;
-    pcl::getTranslationAndEulerAngles(rigidBody.m_lastTransformation, last_x, last_y, last_z, last_roll, last_pitch, last_yaw);
-
-    float vx = (x - last_x) / dt;
-    float vy = (y - last_y) / dt;
-    float vz = (z - last_z) / dt;
-    float wroll = deltaAngle(roll, last_roll) / dt;
-    float wpitch = deltaAngle(pitch, last_pitch) / dt;
-    float wyaw = deltaAngle(yaw, last_yaw) / dt;
-
-    // ROS_INFO("v: %f,%f,%f, w: %f,%f,%f, dt: %f", vx, vy, vz, wroll, wpitch, wyaw, dt);
-
-    if (   fabs(vx) < dynConf.maxXVelocity
-        && fabs(vy) < dynConf.maxYVelocity
-        && fabs(vz) < dynConf.maxZVelocity
-        && fabs(wroll) < dynConf.maxRollRate
-        && fabs(wpitch) < dynConf.maxPitchRate
-        && fabs(wyaw) < dynConf.maxYawRate
-        && fabs(roll) < dynConf.maxRoll
-        && fabs(pitch) < dynConf.maxPitch
-        && icp.getFitnessScore() < dynConf.maxFitnessScore)
-    {
-      rigidBody.m_velocity = (tROTA.translation() - rigidBody.center()) / dt;
-      rigidBody.m_lastTransformation = tROTA;
-      rigidBody.m_lastValidTransform = stamp;
-      rigidBody.m_lastTransformationValid = true;
-      rigidBody.m_hasOrientation = true;
-    } else {
-      std::stringstream sstr;
-      sstr << "Dynamic check failed for rigidBody " << rigidBody.name() << std::endl;
-      if (fabs(vx) >= dynConf.maxXVelocity) {
-        sstr << "vx: " << vx << " >= " << dynConf.maxXVelocity << std::endl;
-      }
-      if (fabs(vy) >= dynConf.maxYVelocity) {
-        sstr << "vy: " << vy << " >= " << dynConf.maxYVelocity << std::endl;
-      }
-      if (fabs(vz) >= dynConf.maxZVelocity) {
-        sstr << "vz: " << vz << " >= " << dynConf.maxZVelocity << std::endl;
-      }
-      if (fabs(wroll) >= dynConf.maxRollRate) {
-        sstr << "wroll: " << wroll << " >= " << dynConf.maxRollRate << std::endl;
-      }
-      if (fabs(wpitch) >= dynConf.maxPitchRate) {
-        sstr << "wpitch: " << wpitch << " >= " << dynConf.maxPitchRate << std::endl;
-      }
-      if (fabs(wyaw) >= dynConf.maxYawRate) {
-        sstr << "wyaw: " << wyaw << " >= " << dynConf.maxYawRate << std::endl;
-      }
-      if (fabs(roll) >= dynConf.maxRoll) {
-        sstr << "roll: " << roll << " >= " << dynConf.maxRoll << std::endl;
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  // match all bodies before touching any of them
+  std::vector<RigidBody*> targets(restored.size(), nullptr);
+  for (size_t i = 0; i < restored.size(); ++i) {
+    for (RigidBody& rigidBody : m_rigidBodies) {
+      if (rigidBody.m_name != restored[i].first) {
+        continue;
       }
-      if (fabs(pitch) >= dynConf.maxPitch) {
-        sstr << "pitch: " << pitch << " >= " << dynConf.maxPitch << std::endl;
+      const MarkerConfigurationDescriptor& desc = *m_markerDescriptors[rigidBody.m_markerConfigurationIdx];
+      bool sameMarkers = restoredMarkers[i].size() == desc.numMarkers;
+      for (size_t j = 0; j < desc.numMarkers && sameMarkers; ++j) {
+        sameMarkers = restoredMarkers[i][j] == pcl2eig((*desc.points)[j]);
       }
-      if (icp.getFitnessScore() >= dynConf.maxFitnessScore) {
-        sstr << "fitness: " << icp.getFitnessScore() << " >= " << dynConf.maxFitnessScore << std::endl;
+      if (!sameMarkers) {
+        throw std::runtime_error("RigidBodyTracker: state of rigid body " + rigidBody.m_name
+          + " was saved with another marker configuration.");
       }
+      targets[i] = &rigidBody;
+      break;
+    }
+  }
+
+  size_t numRestored = 0;
+  for (size_t i = 0; i < restored.size(); ++i) {
+    if (targets[i]) {
+      // configuration and identity stay those of this tracker
+      RigidBody& rigidBody = *targets[i];
+      const RigidBody& saved = restored[i].second;
+      rigidBody.m_lastTransformation = saved.m_lastTransformation;
+      rigidBody.m_hasOrientation = saved.m_hasOrientation;
+      rigidBody.m_positionOnly = saved.m_positionOnly;
+      rigidBody.m_velocity = saved.m_velocity;
+      rigidBody.m_lastValidTransform = saved.m_lastValidTransform;
+      rigidBody.m_lastTransformationValid = saved.m_lastTransformationValid;
+      rigidBody.m_initialized = saved.m_initialized;
+      rigidBody.m_fitnessScore = saved.m_fitnessScore;
+      rigidBody.m_updateCost = saved.m_updateCost;
+      rigidBody.m_initAttempts = saved.m_initAttempts;
+      rigidBody.m_nextInitAttempt = m_frame + saved.m_nextInitAttempt;
+      rigidBody.m_motionFilter = saved.m_motionFilter;
+      ++numRestored;
+    }
+  }
+  updateTrackingMode();
+  // searches started from the previous state are obsolete
+  discardHypotheses();
+  return numRestored;
+}
+
+void RigidBodyTracker::setLogWarningCallback(
+  std::function<void(const std::string&)> logWarn)
+{
+  m_logWarn = logWarn;
+}
+
+void RigidBodyTracker::setPosePublisher(std::shared_ptr<PosePublisher> publisher)
+{
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  m_posePublisher = publisher;
+}
+
+void RigidBodyTracker::setRigidBodyCallback(
+  std::function<void(size_t, const RigidBody&)> callback)
+{
+  m_rigidBodyCallback = callback;
+}
+
+void RigidBodyTracker::setMaxInitializationsPerFrame(size_t maxInitializations)
+{
+  m_maxInitializationsPerFrame = maxInitializations;
+}
+
+void RigidBodyTracker::setBackgroundReacquisition(bool enabled)
+{
+  if (!enabled) {
+    m_reacquisitionWorker.reset();
+    std::lock_guard<std::mutex> lock(m_hypothesesMutex);
+    m_hypotheses.clear();
+  } else if (!m_reacquisitionWorker) {
+    m_reacquisitionWorker.reset(new ReacquisitionWorker);
+  }
+}
+
+void RigidBodyTracker::setPrefilterConfiguration(const PrefilterConfiguration& configuration)
+{
+  m_prefilter.reset(new MarkerPrefilter(configuration));
+}
+
+void RigidBodyTracker::resetIcpIterationHistogram()
+{
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  m_icpIterationHistogram.clear();
+}
+
+void RigidBodyTracker::setNumThreads(size_t numThreads)
+{
+  std::lock_guard<std::mutex> lock(m_updateMutex);
+  m_scheduler.reset(new TaskScheduler(numThreads));
+}
+
+bool RigidBodyTracker::initializePose(
+  std::chrono::high_resolution_clock::time_point stamp,
+  Cloud::ConstPtr markers,
+  const std::vector<size_t>& rigidBodyIdxs)
+{
+  if (markers->size() == 0) {
+    return false;
+  }
+
+  // the same tree serves for knn queries and as ICP target index
+  KdTree::Ptr markerTree(new KdTree);
+  markerTree->setInputCloud(markers);
+
+  float const max_deviation = maxInitialDeviation();
+
+  bool allFitsGood = true;
+  for (size_t iRb : rigidBodyIdxs) {
+    RigidBody& rigidBody = m_rigidBodies[iRb];
+    const MarkerConfigurationDescriptor& desc = *m_markerDescriptors[rigidBody.m_markerConfigurationIdx];
+
+    // find the pose near the rigidBodie's nominal position
+    // (initial pos was loaded into lastTransformation from config file)
+    const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
+    Eigen::Affine3f bestTransformation;
+    std::string error;
+    if (!searchPose(*m_scheduler, desc, markers, markerTree, rigidBody.center(),
+          max_deviation, dynConf.maxFitnessScore, bestTransformation, error)) {
+      std::stringstream sstr;
+      sstr << "error: " << error << " for rigid body " << rigidBody.name();
       logWarn(sstr.str());
+      allFitsGood = false;
+      continue;
     }
+
+    // PoseMode and CentroidMode bodies both start from the searched pose.
+    // markers only holds what tracked bodies left over, but bodies acquired
+    // in the same frame do not exclude each other's markers; if two settle
+    // on the same markers, the group assignment of the next frame resolves
+    // it.
+    rigidBody.m_lastTransformation = bestTransformation;
+    rigidBody.m_lastValidTransform = stamp;
+    rigidBody.m_lastTransformationValid = true;
+    rigidBody.m_hasOrientation = true;
+    rigidBody.m_initialized = true;
   }
 
+  return allFitsGood;
 }
 
 bool RigidBodyTracker::initializePosition(
   std::chrono::high_resolution_clock::time_point stamp,
-  Cloud::ConstPtr markers)
+  Cloud::ConstPtr markers,
+  const std::vector<size_t>& rigidBodyIdxs)
 {
   // Here, we use a simple task assignment to find the best initial matching
   libMultiRobotPlanning::Assignment<size_t, size_t> assignment;
 
+  // like searchPose(), only markers near the last known position are
+  // considered; a body with none in reach stays unassigned
+  float const maxDeviation = maxInitialDeviation();
   for (size_t i = 0; i < markers->size(); ++i) {
     Eigen::Vector3f marker = pcl2eig((*markers)[i]);
-    for (size_t j = 0; j < m_rigidBodies.size(); ++j) {
-      auto pi = m_rigidBodies[j].initialCenter();
+    for (size_t j : rigidBodyIdxs) {
+      // last known position; this is the initial position until the first fix
+      auto pi = m_rigidBodies[j].center();
       float dist = (pi - marker).norm();
+      if (dist > maxDeviation) {
+        continue;
+      }
       long cost = dist * 1000; // cost needs to be an integer -> convert to mm
       assignment.setCost(j, i, cost);
     }
@@ -428,23 +1144,21 @@ bool RigidBodyTracker::initializePosition(
   for (const auto& s : solution) {
     auto& rigidBody = m_rigidBodies[s.first];
     Eigen::Vector3f marker = pcl2eig((*markers)[s.second]);
-    Eigen::Vector3f offset = pcl2eig((*m_markerConfigurations[rigidBody.m_markerConfigurationIdx])[0]);
+    Eigen::Vector3f offset = m_markerDescriptors[rigidBody.m_markerConfigurationIdx]->offset;
     rigidBody.m_lastTransformation = Eigen::Translation3f(marker + offset);
     rigidBody.m_lastValidTransform = stamp;
     rigidBody.m_lastTransformationValid = true;
     rigidBody.m_hasOrientation = false;
+    rigidBody.m_initialized = true;
   }
 
-  return solution.size() == m_rigidBodies.size();
+  return solution.size() == rigidBodyIdxs.size();
 }
 
-void RigidBodyTracker::updatePosition(std::chrono::high_resolution_clock::time_point stamp,
+void RigidBodyTracker::updateRigidBodies(std::chrono::high_resolution_clock::time_point stamp,
   Cloud::ConstPtr markers)
 {
-  static std::chrono::high_resolution_clock::time_point lastCall;
-  std::chrono::duration<double> lastCallElapsedSeconds = stamp-lastCall;
-  double lastCalldt = lastCallElapsedSeconds.count();
-  lastCall = stamp;
+  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 
   if (markers->empty()) {
     for (auto& rigidBody : m_rigidBodies) {
@@ -453,565 +1167,288 @@ void RigidBodyTracker::updatePosition(std::chrono::high_resolution_clock::time_p
     return;
   }
 
-  // re-initialize, if we have not received an update in a long time
-  if (!m_initialized || lastCalldt > 0.4) {
-    m_initialized = initializePosition(stamp, markers);
-    if (!m_initialized) {
-      logWarn(
-        "rigid body tracker initialization failed - "
-        "check that position is correct, all markers are visible, "
-        "and marker configuration matches config file");
-    }
-    // Doesn't make too much sense to continue here - lets wait to be fully initialized
-    return;
-  }
-
-  // In this case, we setup a task assignment problem, only considering markers that are in
-  // close proximity to the previously known position. If we do not have a match for a
-  // fixed amount of time, abandon that robot entirely (to avoid issues with spurios markers).
-  libMultiRobotPlanning::Assignment<size_t, size_t> assignment; // rigidBodyIdx -> markerIdx
-
-  // prepare for knn query
-  std::vector<int> nearestIdx(5); // tune maximum number of neighbors here
-  std::vector<float> nearestSqrDist(nearestIdx.size());
-  pcl::KdTreeFLANN<Point> kdtree;
-  kdtree.setInputCloud(markers);
+  // all per-body queries and registrations share one search tree
+  KdTree::Ptr markerTree(new KdTree);
+  markerTree->setInputCloud(markers);
 
   size_t const numRigidBodies = m_rigidBodies.size();
-  for (int iRb = 0; iRb < numRigidBodies; ++iRb) {
+  std::vector<std::vector<TrackingCandidate>> rbCandidates(numRigidBodies);
+  std::vector<uint8_t> rbAcquire(numRigidBodies, false);
+  // index of the candidate a body took, -1 while unresolved
+  std::vector<int> rbChosen(numRigidBodies, -1);
+
+  auto applyCandidate = [&](size_t iRb, size_t candidateIdx) {
+    const TrackingCandidate& candidate = rbCandidates[iRb][candidateIdx];
+    rbChosen[iRb] = candidateIdx;
     RigidBody& rigidBody = m_rigidBodies[iRb];
-    Eigen::Vector3f offset = pcl2eig((*m_markerConfigurations[rigidBody.m_markerConfigurationIdx])[0]);
+    std::chrono::duration<double> elapsedSeconds = stamp - rigidBody.m_lastValidTransform;
+    rigidBody.m_velocity = (candidate.transformation.translation() - rigidBody.center()) / elapsedSeconds.count();
+    rigidBody.m_lastTransformation = candidate.transformation;
+    rigidBody.m_lastValidTransform = stamp;
+    rigidBody.m_lastTransformationValid = true;
+    rigidBody.m_hasOrientation = rigidBody.m_trackingMode == PoseMode;
+    if (rigidBody.m_hasOrientation) {
+      rigidBody.m_fitnessScore = candidate.fitnessScore;
+    }
+  };
 
+  // Single-marker bodies: each reachable marker is a candidate.
+  std::vector<int> nearestIdx;
+  std::vector<float> nearestSqrDist;
+  for (size_t iRb = 0; iRb < numRigidBodies; ++iRb) {
+    RigidBody& rigidBody = m_rigidBodies[iRb];
+    const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
     rigidBody.m_lastTransformationValid = false;
 
-    std::chrono::duration<double> elapsedSeconds = stamp-rigidBody.m_lastValidTransform;
-    double dt = elapsedSeconds.count();
-    if (dt > 0.5) {
-      std::stringstream sstr;
-      sstr << "Lost tracking for rigidBody " << rigidBody.name() << " skipping";
-      logWarn(sstr.str());
+    std::chrono::duration<double> elapsedSeconds = stamp - rigidBody.m_lastValidTransform;
+    if (!rigidBody.m_initialized || elapsedSeconds.count() > dynConf.reinitTimeout) {
+      if (rigidBody.m_initialized) {
+        std::stringstream sstr;
+        sstr << "Lost tracking for rigidBody " << rigidBody.name() << " re-initializing";
+        logWarn(sstr.str());
+      }
+      rbAcquire[iRb] = true;
       continue;
     }
-
-    auto nominalCenter = eig2pcl(rigidBody.center());
-    int nFound = kdtree.nearestKSearch(
-      nominalCenter, nearestIdx.size(), nearestIdx, nearestSqrDist);
-
-    if (nFound < 1) {
-      std::stringstream sstr;
-      sstr << "error: no neighbors found for rigidBody " << rigidBody.name();
-      logWarn(sstr.str());
+    if (rigidBody.m_trackingMode != PositionMode) {
       continue;
     }
 
-    const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
-
-    bool foundPotentialMarker = false;
+    Eigen::Vector3f offset = m_markerDescriptors[rigidBody.m_markerConfigurationIdx]->offset;
+    Eigen::Vector3f predictedCenter;
+    Eigen::Vector3f semiAxes = motionGate(rigidBody, dynConf, stamp, predictedCenter);
+    int nFound = reachableMarkers(*markerTree, markers, predictedCenter - offset,
+      semiAxes, dynConf.maxMarkerCandidates, nearestIdx, nearestSqrDist);
     for (int iMarker = 0; iMarker < nFound; ++iMarker) {
-      Eigen::Vector3f marker = pcl2eig((*markers)[nearestIdx[iMarker]]);
-
-      // Compute changes:
-      Eigen::Vector3f velocity = (marker - rigidBody.center() + offset) / dt;
-      float vx = velocity.x();
-      float vy = velocity.y();
-      float vz = velocity.z();
-
-      if (   fabs(vx) < dynConf.maxXVelocity
-          && fabs(vy) < dynConf.maxYVelocity
-          && fabs(vz) < dynConf.maxZVelocity)
-      {
-        float dist = (marker - rigidBody.center() + offset).norm();
-        long cost = dist * 1000; // cost needs to be an integer -> convert to mm
-        assignment.setCost(iRb, nearestIdx[iMarker], cost);
-        foundPotentialMarker = true;
-      }
+      TrackingCandidate candidate;
+      candidate.markers.push_back(nearestIdx[iMarker]);
+      // cost needs to be an integer -> convert to mm
+      candidate.cost = std::sqrt(nearestSqrDist[iMarker]) * 1000;
+      candidate.transformation = Eigen::Translation3f(pcl2eig((*markers)[nearestIdx[iMarker]]) + offset);
+      candidate.fitnessScore = 0;
+      rbCandidates[iRb].push_back(candidate);
     }
-    if (!foundPotentialMarker) {
+    if (nFound < 1) {
       std::stringstream sstr;
       sstr << "all dynamic check failed for rigidBody " << rigidBody.name() << std::endl;
       logWarn(sstr.str());
     }
   }
 
-  std::map<size_t, size_t> solution; // maps rigidBodyId->markerId
-  long totalCost = assignment.solve(solution);
-
-  for (const auto& s : solution) {
-    auto& rigidBody = m_rigidBodies[s.first];
-    Eigen::Vector3f marker = pcl2eig((*markers)[s.second]);
-    Eigen::Vector3f offset = pcl2eig((*m_markerConfigurations[rigidBody.m_markerConfigurationIdx])[0]);
-    std::chrono::duration<double> elapsedSeconds = stamp-rigidBody.m_lastValidTransform;
+  // Multi-marker bodies: a single registration (or centroid estimate) each.
+  runPerRigidBody([&](size_t iRb) {
+    RigidBody& rigidBody = m_rigidBodies[iRb];
+    if (rbAcquire[iRb] || rigidBody.m_trackingMode == PositionMode) {
+      return;
+    }
+    const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
+    const MarkerConfigurationDescriptor& desc = *m_markerDescriptors[rigidBody.m_markerConfigurationIdx];
+    std::chrono::duration<double> elapsedSeconds = stamp - rigidBody.m_lastValidTransform;
     double dt = elapsedSeconds.count();
 
-    rigidBody.m_velocity = (marker - rigidBody.center() + offset) / dt;
-    rigidBody.m_lastTransformation = Eigen::Translation3f(marker + offset);
-    rigidBody.m_lastValidTransform = stamp;
-    rigidBody.m_lastTransformationValid = true;
-    rigidBody.m_hasOrientation = false;
-  }
-}
-
-bool RigidBodyTracker::initializeHybrid(
-  std::chrono::high_resolution_clock::time_point stamp, 
-  Cloud::ConstPtr markersConst)
-{
-  if (markersConst->size() == 0) {
-    return false;
-  }
-
-  // we need to mutate the cloud by deleting points
-  // once they are assigned to an rigid body
-  Cloud::Ptr markers(new Cloud(*markersConst));
-
-  size_t const numRigidBodies = m_rigidBodies.size();
+    Eigen::Vector3f predictedCenter;
+    Eigen::Vector3f semiAxes = motionGate(rigidBody, dynConf, stamp, predictedCenter);
 
-  ICP icp;
-  icp.setMaximumIterations(5);
-  icp.setInputTarget(markers);
-
-  // prepare for knn query
-  std::vector<int> nearestIdx;
-  std::vector<float> nearestSqrDist;
-  std::vector<int> rbTakePts;
-  pcl::KdTreeFLANN<Point> kdtree;
-  kdtree.setInputCloud(markers);
-
-  // compute the distance between the closest 2 rigidBodies in the nominal configuration
-  // we will use this value to limit allowed deviation from nominal positions
-  float closest = std::numeric_limits<float>::max();
-  for (int i = 0; i < numRigidBodies; ++i) {
-    auto pi = m_rigidBodies[i].initialCenter();
-    for (int j = i + 1; j < numRigidBodies; ++j) {
-      float dist = (pi - m_rigidBodies[j].initialCenter()).norm();
-      closest = std::min(closest, dist);
+    if (rigidBody.m_trackingMode == CentroidMode) {
+      rigidBody.m_icpIterations = 0;
+      TrackingCandidate candidate;
+      std::stringstream violations;
+      if (!centroidEstimate(*markerTree, markers, desc, rigidBody.m_lastTransformation, predictedCenter,
+            semiAxes.maxCoeff(), candidate.transformation, candidate.fitnessScore, candidate.markers)) {
+        std::stringstream sstr;
+        sstr << "Not all markers in reach of rigidBody " << rigidBody.name();
+        logWarn(sstr.str());
+        return;
+      }
+      if (!withinTranslationDynamics(dynConf, rigidBody.center(), candidate.transformation.translation(),
+            dt, candidate.fitnessScore, dynConf.maxSpreadDeviation, violations)) {
+        std::stringstream sstr;
+        sstr << "Dynamic check failed for rigidBody " << rigidBody.name() << std::endl
+             << violations.str();
+        logWarn(sstr.str());
+        return;
+      }
+      candidate.cost = (candidate.transformation.translation() - rigidBody.center()).norm() * 1000;
+      rbCandidates[iRb].push_back(candidate);
+      return;
     }
-  }
-  float const max_deviation = closest / 3;
-
-  //printf("Rigid Body tracker: limiting distance from nominal position "
-  //  "to %f meters\n", max_deviation);
 
-  bool allFitsGood = true;
-  for (int iRb = 0; iRb < numRigidBodies; ++iRb) {
-    RigidBody& rigidBody = m_rigidBodies[iRb];
-    Cloud::Ptr &rbMarkers =
-      m_markerConfigurations[rigidBody.m_markerConfigurationIdx];
-    icp.setInputSource(rbMarkers);
+    ICP icp;
+    icp.setInputTarget(markers);
+    icp.setSearchMethodTarget(markerTree, true);
 
-    // find the points nearest to the rigidBodie's nominal position
-    // (initial pos was loaded into lastTransformation from config file)
-    size_t const rbNpts = rbMarkers->size();
-    nearestIdx.resize(rbNpts);
-    nearestSqrDist.resize(rbNpts);
-    auto nominalCenter = eig2pcl(rigidBody.initialCenter());
-    int nFound = kdtree.nearestKSearch(
-      nominalCenter, rbNpts, nearestIdx, nearestSqrDist);
-
-    if (nFound < rbNpts) {
-      std::stringstream sstr;
-      sstr << "error: only " << nFound
-           << " neighbors found for rigid body " << rigidBody.name()
-           << " (need " << rbNpts << ")";
-      logWarn(sstr.str());
-      allFitsGood = false;
-      continue;
-    }
+    // Set the max correspondence distance
+    float maxDisplacement = maxMarkerDisplacement(dynConf, desc, dt, semiAxes.maxCoeff());
+    icp.setMaxCorrespondenceDistance(maxDisplacement);
+    // Set the termination criteria (iterations, epsilons)
+    configureTrackingICP(icp, dynConf, rigidBody.m_velocity.norm() * dt,
+      maxDisplacement, rigidBody.m_fitnessScore);
 
-    if (rbNpts == 1 && nFound == 1)  {  
-      Eigen::Vector3f marker = pcl2eig((*markers)[nearestIdx[0]]);
-      auto pi = rigidBody.initialCenter();
-      float dist = (pi - marker).norm();
+    icp.setInputSource(desc.points);
 
-      Eigen::Vector3f offset = pcl2eig((*m_markerConfigurations[rigidBody.m_markerConfigurationIdx])[0]);
-      rigidBody.m_lastTransformation = Eigen::Translation3f(marker + offset);
-      rigidBody.m_lastValidTransform = stamp;  
-      rigidBody.m_lastTransformationValid = true;
-      rigidBody.m_hasOrientation = false;
-      continue;
-    }
-    else if (rbNpts == 1){
+    Cloud result;
+    Eigen::Affine3f predictTransform =
+      Eigen::Translation3f(predictedCenter - rigidBody.center()) * rigidBody.m_lastTransformation;
+    icp.align(result, predictTransform.matrix());
+    rigidBody.m_icpIterations = icp.iterations();
+    if (!icp.hasConverged()) {
       std::stringstream sstr;
-      sstr << "error: only " << nFound
-           << " neighbors found for rigid body " << rigidBody.name()
-           << " (need " << rbNpts << ")";
+      sstr << "ICP did not converge!"
+           << " for rigidBody " << rigidBody.name();
       logWarn(sstr.str());
-      continue;
+      return;
     }
 
-    // only try to fit the rigid body if the k nearest neighbors
-    // are reasonably close to the nominal rigid body position
-    Eigen::Vector3f actualCenter(0, 0, 0);
-    for (int i = 0; i < rbNpts; ++i) {
-      actualCenter += pcl2eig((*markers)[nearestIdx[i]]);
-    }
-    actualCenter /= rbNpts;
-    if ((actualCenter - pcl2eig(nominalCenter)).norm() > max_deviation) {
+    TrackingCandidate candidate;
+    candidate.transformation = Eigen::Affine3f(icp.getFinalTransformation());
+    candidate.fitnessScore = icp.getFitnessScore();
+    std::stringstream violations;
+    if (!withinDynamics(dynConf, rigidBody.m_lastTransformation, candidate.transformation,
+          dt, candidate.fitnessScore, violations)) {
       std::stringstream sstr;
-      sstr << "error: nearest neighbors of rigid body " << rigidBody.name()
-           << " are centered at " << actualCenter
-           << " instead of " << nominalCenter;
+      sstr << "Dynamic check failed for rigidBody " << rigidBody.name() << std::endl
+           << violations.str();
       logWarn(sstr.str());
-      allFitsGood = false;
-      continue;
+      return;
     }
 
-    // try ICP with guesses of many different yaws about knn centroid
-    Cloud result;
-    static int const N_YAW = 20;
-    double bestErr = std::numeric_limits<double>::max();
-    Eigen::Affine3f bestTransformation;
-    for (int i = 0; i < N_YAW; ++i) {
-      float yaw = i * (2 * M_PI / N_YAW);
-      Eigen::Matrix4f tryMatrix = pcl::getTransformation(
-        actualCenter.x(), actualCenter.y(), actualCenter.z(),
-        0, 0, yaw).matrix();
-      icp.align(result, tryMatrix);
-      if (icp.hasConverged()) {
-        double err = icp.getFitnessScore();
-        if (err < bestErr) {
-          bestErr = err;
-          bestTransformation = icp.getFinalTransformation();
+    // markers matched by the aligned configuration (ICP's correspondences
+    // within the correspondence distance) are taken
+    const std::vector<int>& correspondences = icp.correspondences();
+    const std::vector<float>& sqrResiduals = icp.sqrResiduals();
+    float const maxSqrResidual = maxDisplacement * maxDisplacement;
+    for (size_t i = 0; i < correspondences.size(); ++i) {
+      int const idx = correspondences[i];
+      if (idx >= 0 && sqrResiduals[i] <= maxSqrResidual) {
+        candidate.markers.push_back(idx);
+      }
+    }
+    std::sort(candidate.markers.begin(), candidate.markers.end());
+    candidate.markers.erase(std::unique(candidate.markers.begin(), candidate.markers.end()),
+      candidate.markers.end());
+    candidate.cost = (candidate.transformation.translation() - rigidBody.center()).norm() * 1000;
+    rbCandidates[iRb].push_back(candidate);
+  });
+
+  // Only now that the candidates of all bodies are known, bodies are
+  // grouped into components of bodies that share candidate markers. Each
+  // component is resolved on its own: a single body takes its cheapest
+  // candidate, single-marker bodies only need the linear assignment, and
+  // all other components need the group search.
+  std::vector<size_t> parent(numRigidBodies);
+  std::iota(parent.begin(), parent.end(), 0);
+  std::vector<int> markerOwner(markers->size(), -1);
+  for (size_t iRb = 0; iRb < numRigidBodies; ++iRb) {
+    for (const auto& candidate : rbCandidates[iRb]) {
+      for (int idx : candidate.markers) {
+        if (markerOwner[idx] < 0) {
+          markerOwner[idx] = iRb;
+        } else {
+          parent[findRoot(parent, iRb)] = findRoot(parent, markerOwner[idx]);
         }
       }
     }
-
-    const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
-    if (bestErr >= dynConf.maxFitnessScore) {
-      std::stringstream sstr;
-      sstr << "Initialize did not succeed (fitness too low) "
-           << " for rigidBody " << rigidBody.name();
-      logWarn(sstr.str());
-      allFitsGood = false;
+  }
+  std::map<size_t, std::vector<size_t>> components;
+  for (size_t iRb = 0; iRb < numRigidBodies; ++iRb) {
+    if (rbCandidates[iRb].empty()) {
       continue;
     }
-
-    // if the fit was good, this rigid body "takes" the markers, and they become
-    // unavailable to all other rigidBodies so we don't double-assign markers
-    // (TODO: this is so greedy... do we need a more global approach?)
-    rigidBody.m_lastTransformation = bestTransformation;
-    rigidBody.m_lastValidTransform = stamp;  
-
-    // remove highest indices first
-    std::sort(rbTakePts.rbegin(), rbTakePts.rend());
-    for (int idx : rbTakePts) {
-      markers->erase(markers->begin() + idx);
-    }
-    // update search structures after deleting markers
-    icp.setInputTarget(markers);
-    kdtree.setInputCloud(markers);
+    components[findRoot(parent, iRb)].push_back(iRb);
   }
 
-  ++m_init_attempts;
-  return allFitsGood;
-}
-
-void RigidBodyTracker::updateHybrid(std::chrono::high_resolution_clock::time_point stamp,
-  Cloud::ConstPtr markers)   
-{
-  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
-
-  static std::chrono::high_resolution_clock::time_point lastCall;
-  std::chrono::duration<double> lastCallElapsedSeconds = stamp-lastCall;
-  double lastCalldt = lastCallElapsedSeconds.count();
-  lastCall = stamp;
-
-  if (markers->empty()) {
-    for (auto& rigidBody : m_rigidBodies) {
-      rigidBody.m_lastTransformationValid = false;
+  // uncontested bodies are final right away, so they are notified before
+  // the contested ones are resolved
+  for (const auto& component : components) {
+    const std::vector<size_t>& rbIdxs = component.second;
+    if (rbIdxs.size() == 1) {
+      const auto& candidates = rbCandidates[rbIdxs[0]];
+      applyCandidate(rbIdxs[0], std::min_element(candidates.begin(), candidates.end(),
+        [](const TrackingCandidate& a, const TrackingCandidate& b) { return a.cost < b.cost; })
+        - candidates.begin());
+      notifyRigidBody(rbIdxs[0]);
     }
-    return;
-  }
-
-
-  m_initialized = m_initialized || initializeHybrid(stamp,markers);
-  if (!m_initialized) {
-    logWarn(
-      "rigid body tracker initialization failed - "
-      "check that position is correct, all markers are visible, "
-      "and marker configuration matches config file");
-    // Doesn't make too much sense to continue here - lets wait to be fully initialized
-    return;
-  }
-  if (lastCalldt > 0.4){
-    m_initialized = initializeHybrid(stamp,markers);
   }
 
-
-  ICP icp;
-  icp.setMaximumIterations(5);  
-  icp.setInputTarget(markers);   
-
-
-  // prepare for knn query
-  std::vector<int> nearestIdx(5); // tune maximum number of neighbors here
-  std::vector<float> nearestSqrDist(nearestIdx.size());
-  pcl::KdTreeFLANN<Point> kdtree;
-  kdtree.setInputCloud(markers);
-
-  CBS_Assignment<std::string, std::string> CBS_assignment;
-  std::set<CBS_InputData> cbs_data_set;
-  std::map<std::tuple<std::string, std::set<std::string>>, Eigen::Affine3f> groupsMap_Affine;
-
-  size_t const numRigidBodies = m_rigidBodies.size();
-  for (int iRb = 0; iRb < numRigidBodies; ++iRb) {
-
-    RigidBody& rigidBody = m_rigidBodies[iRb];
-    Cloud::Ptr &rbMarkers = m_markerConfigurations[rigidBody.m_markerConfigurationIdx];
-    size_t const rbNpts = rbMarkers->size();
-
-    std::chrono::duration<double> elapsedSeconds = stamp-rigidBody.m_lastValidTransform;
-    double dt = elapsedSeconds.count();
-
-    // Set the max correspondence distance
-    const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
-
-    if (dt > 0.5) {
-      std::stringstream sstr;
-      sstr << "Lost tracking for rigidBody " << rigidBody.name()<< "dt"<< dt << " skipping";
-      logWarn(sstr.str());
+  for (const auto& component : components) {
+    const std::vector<size_t>& rbIdxs = component.second;
+    if (rbIdxs.size() == 1) {
       continue;
     }
+    bool positionOnly = true;
+    for (size_t iRb : rbIdxs) {
+      positionOnly = positionOnly && m_rigidBodies[iRb].m_trackingMode == PositionMode;
+    }
 
-    if (rbNpts == 1) {
-      auto nominalCenter = eig2pcl(rigidBody.center());
-      int nFound = kdtree.nearestKSearch(
-        nominalCenter, nearestIdx.size(), nearestIdx, nearestSqrDist);
-      if (nFound < 1) {
-        std::stringstream sstr;
-        sstr << "error: no neighbors found for rigidBody " << rigidBody.name();
-        logWarn(sstr.str());
-        continue;
+    if (positionOnly) {
+      libMultiRobotPlanning::Assignment<size_t, size_t> assignment; // rigidBodyIdx -> candidateIdx
+      std::map<size_t, std::map<int, size_t>> markerToCandidate;
+      for (size_t iRb : rbIdxs) {
+        for (size_t i = 0; i < rbCandidates[iRb].size(); ++i) {
+          int idx = rbCandidates[iRb][i].markers[0];
+          assignment.setCost(iRb, idx, rbCandidates[iRb][i].cost);
+          markerToCandidate[iRb][idx] = i;
+        }
       }
-
-      Eigen::Vector3f offset = pcl2eig((*m_markerConfigurations[rigidBody.m_markerConfigurationIdx])[0]);
-      bool foundPotentialMarker = false;
-      for (int iMarker = 0; iMarker < nFound; ++iMarker) {   // loop all the near markers
-        Eigen::Vector3f marker = pcl2eig((*markers)[nearestIdx[iMarker]]);
-
-        // Compute changes:
-        Eigen::Vector3f velocity = (marker - rigidBody.center() + offset) / dt;
-        float vx = velocity.x();
-        float vy = velocity.y();
-        float vz = velocity.z();
-
-        if (   fabs(vx) < dynConf.maxXVelocity
-            && fabs(vy) < dynConf.maxYVelocity
-            && fabs(vz) < dynConf.maxZVelocity)
-        {
-          float dist = (marker - rigidBody.center() + offset).norm();
-          long cost = dist* 10e3;
+      std::map<size_t, size_t> assigned; // maps rigidBodyId->markerId
+      assignment.solve(assigned);
+      for (const auto& s : assigned) {
+        applyCandidate(s.first, markerToCandidate[s.first][s.second]);
+      }
+    } else {
+      std::set<CBS_InputData> cbsData;
+      for (size_t iRb : rbIdxs) {
+        for (const auto& candidate : rbCandidates[iRb]) {
           CBS_InputData data;
-          data.taskSet.insert(std::to_string(nearestIdx[iMarker]));
           data.agent = std::to_string(iRb);
-          data.cost = cost;
-          cbs_data_set.insert(data);
-          foundPotentialMarker = true;
+          data.taskSet = taskSet(candidate);
+          data.cost = candidate.cost;
+          cbsData.insert(data);
         }
       }
-      if (!foundPotentialMarker) {
+      HighLevelNode P = solveGroupAssignment(cbsData);
+      if (P.solution.empty()) {
         std::stringstream sstr;
-        sstr << "all dynamic check failed for rigidBody " << rigidBody.name() << std::endl;
+        sstr << "Cannot find a solution!";
         logWarn(sstr.str());
       }
-      continue;
-    }
-
-    float maxV = dynConf.maxXVelocity;
-    icp.setMaxCorrespondenceDistance(maxV * dt);   
-
-    // Update input source
-    icp.setInputSource(m_markerConfigurations[rigidBody.m_markerConfigurationIdx]);   // move configure to frame point cloud 
-    
-    // Perform the alignment for k times
-    int k= 3; 
-    auto predictTransform = rigidBody.m_lastTransformation;      
-
-    // std::cout << "-----try k times icp :----  \n";   
-    for (size_t i = 0; i < k; ++i)  {
-      Cloud result; 
-      icp.align(result, predictTransform.matrix());  
-
-      if (!icp.hasConverged()) {
-        std::stringstream sstr;
-        sstr << "ICP did not converge!"
-            << " for rigidBody " << rigidBody.name();
-        logWarn(sstr.str());
-        continue;
-      }
-
-      Eigen::Matrix4f transformation = icp.getFinalTransformation();
-      Eigen::Affine3f tROTA(transformation);
-
-      float x, y, z, roll, pitch, yaw;
-      pcl::getTranslationAndEulerAngles(tROTA, x, y, z, roll, pitch, yaw);
-      float last_x, last_y, last_z, last_roll, last_pitch, last_yaw;
-      pcl::getTranslationAndEulerAngles(rigidBody.m_lastTransformation, last_x, last_y, last_z, last_roll, last_pitch, last_yaw);
-
-      float vx = (x - last_x) / dt;
-      float vy = (y - last_y) / dt;
-      float vz = (z - last_z) / dt;
-      float wroll = deltaAngle(roll, last_roll) / dt;
-      float wpitch = deltaAngle(pitch, last_pitch) / dt;
-      float wyaw = deltaAngle(yaw, last_yaw) / dt;
-
-      // ROS_INFO("v: %f,%f,%f, w: %f,%f,%f, dt: %f", vx, vy, vz, wroll, wpitch, wyaw, dt);
-
-      if (   fabs(vx) < dynConf.maxXVelocity
-          && fabs(vy) < dynConf.maxYVelocity
-          && fabs(vz) < dynConf.maxZVelocity
-          && fabs(wroll) < dynConf.maxRollRate
-          && fabs(wpitch) < dynConf.maxPitchRate
-          && fabs(wyaw) < dynConf.maxYawRate
-          && fabs(roll) < dynConf.maxRoll
-          && fabs(pitch) < dynConf.maxPitch
-          && icp.getFitnessScore() < dynConf.maxFitnessScore)
-      {
-        CBS_InputData data;
-        // Get the correspondence indices
-        std::vector<size_t> correspondences;
-        pcl::search::KdTree<Point>::Ptr search_tree = icp.getSearchMethodTarget();
-        for (auto point : result.points) {
-          std::vector<int> matched_indices;
-          std::vector<float> matched_distances;
-          search_tree->nearestKSearch(point, 1, matched_indices, matched_distances);
-          correspondences.push_back(matched_indices[0]);
-          data.taskSet.insert(std::to_string(matched_indices[0]));
+      for (const auto& s : P.solution) {
+        size_t iRb = std::stoi(s.first);
+        for (size_t i = 0; i < rbCandidates[iRb].size(); ++i) {
+          if (taskSet(rbCandidates[iRb][i]) == s.second) {
+            applyCandidate(iRb, i);
+            break;
+          }
         }
-         
-        float dist = sqrt(pow(x - last_x, 2) + pow(y - last_y, 2) + pow(z - last_z, 2));
-        long cost = dist* 10e3;
-
-        data.agent = std::to_string(iRb);
-        data.cost = cost;
-        cbs_data_set.insert(data);
-
-        groupsMap_Affine[std::make_tuple(data.agent, data.taskSet)] = tROTA;
-
-
-      } else {
-        std::stringstream sstr;
-        sstr << "Dynamic check failed for rigidBody " << rigidBody.name() << std::endl;
-        if (fabs(vx) >= dynConf.maxXVelocity) {
-          sstr << "vx: " << vx << " >= " << dynConf.maxXVelocity << std::endl;
-        }
-        if (fabs(vy) >= dynConf.maxYVelocity) {
-          sstr << "vy: " << vy << " >= " << dynConf.maxYVelocity << std::endl;
-        }
-        if (fabs(vz) >= dynConf.maxZVelocity) {
-          sstr << "vz: " << vz << " >= " << dynConf.maxZVelocity << std::endl;
-        }
-        if (fabs(wroll) >= dynConf.maxRollRate) {
-          sstr << "wroll: " << wroll << " >= " << dynConf.maxRollRate << std::endl;
-        }
-        if (fabs(wpitch) >= dynConf.maxPitchRate) {
-          sstr << "wpitch: " << wpitch << " >= " << dynConf.maxPitchRate << std::endl;
-        }
-        if (fabs(wyaw) >= dynConf.maxYawRate) {
-          sstr << "wyaw: " << wyaw << " >= " << dynConf.maxYawRate << std::endl;
-        }
-        if (fabs(roll) >= dynConf.maxRoll) {
-          sstr << "roll: " << roll << " >= " << dynConf.maxRoll << std::endl;
-        }
-        if (fabs(pitch) >= dynConf.maxPitch) {
-          sstr << "pitch: " << pitch << " >= " << dynConf.maxPitch << std::endl;
-        }
-        if (icp.getFitnessScore() >= dynConf.maxFitnessScore) {
-          sstr << "fitness: " << icp.getFitnessScore() << " >= " << dynConf.maxFitnessScore << std::endl;
-        }
-        logWarn(sstr.str());
       }
     }
-  }
-
-  for (const auto& data : cbs_data_set) {
-    CBS_assignment.setCost(data.agent, data.taskSet, data.cost);
-  }
-
-  std::map<std::string, std::set<std::string>> solution;
-  int64_t CBS_assignment_cost = CBS_assignment.solve(solution);
-  HighLevelNode start;
-  start.id = 0;
-  start.cost = CBS_assignment_cost;
-  start.solution = solution;
-  typename boost::heap::d_ary_heap<HighLevelNode, boost::heap::arity<2>,
-                                    boost::heap::mutable_<true> >
-      open;
-
-  auto handle = open.push(start);
-  (*handle).handle = handle;
-
-  bool outputToFile = false; 
-  solution.clear();
-  int id = 1;
-  HighLevelNode P;
-  int m_highLevelExpanded = 0; 
-  int m_lowLevelExpanded = 0;
-  int duplicate = 0;
-  while (!open.empty()) {
-    m_highLevelExpanded++;
-    P = open.top();
-    open.pop();
-    // std::cout << P;
-
-    if (P.solution.empty()) {
-      std::stringstream sstr;
-      sstr << "Cannot find a solution!";
-      logWarn(sstr.str());
-    }
 
-    std::string conflict_task;
-    if (!getFirstConflict(P.solution,conflict_task)) {
-      // std::cout << "no conflict_task, Breaking out of the loop.\n";
-      outputToFile = true; 
-      break;
-    }
-    std::set<std::set<Constraint>> new_constraints;
-    createConstraintsFromConflict(P.solution,conflict_task,new_constraints);
-    for (const auto& new_constraint_set : new_constraints) {
-      HighLevelNode newNode;
-      LowLevelSearch(new_constraint_set,cbs_data_set,P,newNode,id);
-      auto handle = open.push(newNode);
-      (*handle).handle = handle;
+    for (size_t iRb : rbIdxs) {
+      notifyRigidBody(iRb);
     }
   }
 
-  for (const auto& s : P.solution) {
-    auto& rigidBody = m_rigidBodies[std::stoi(s.first)]; 
-    std::set<std::string> current_set = s.second;
-    std::chrono::duration<double> elapsedSeconds = stamp-rigidBody.m_lastValidTransform;
-    double dt = elapsedSeconds.count();
-
-    if (current_set.size() == 1) {
-        int markerIndex = std::stoi(*current_set.begin());
-        Eigen::Vector3f marker = pcl2eig((*markers)[markerIndex]);
-        Eigen::Vector3f offset = pcl2eig((*m_markerConfigurations[rigidBody.m_markerConfigurationIdx])[0]);
-
-        rigidBody.m_velocity = (marker - rigidBody.center() + offset) / dt;
-        rigidBody.m_lastTransformation = Eigen::Translation3f(marker + offset);
-        rigidBody.m_lastValidTransform = stamp;
-        rigidBody.m_lastTransformationValid = true;
-        rigidBody.m_hasOrientation = false;
-    }
-    else{ 
-      auto searchKey = std::make_tuple(s.first, s.second);
-      if (groupsMap_Affine.find(searchKey) != groupsMap_Affine.end()) {
-        rigidBody.m_lastTransformation = groupsMap_Affine[searchKey];
-      } 
-
-      rigidBody.m_velocity = (rigidBody.m_lastTransformation.translation() - rigidBody.center()) / dt;
-      rigidBody.m_lastValidTransform = stamp;
-      rigidBody.m_lastTransformationValid = true;
-      rigidBody.m_hasOrientation = true;
+  // uninitialized and lost bodies are acquired from the markers the
+  // tracked ones left over
+  std::vector<bool> markerClaimed(markers->size(), false);
+  std::vector<size_t> acquireRigidBodies;
+  for (size_t iRb = 0; iRb < numRigidBodies; ++iRb) {
+    if (rbAcquire[iRb]) {
+      acquireRigidBodies.push_back(iRb);
+    } else if (rbChosen[iRb] >= 0) {
+      for (int idx : rbCandidates[iRb][rbChosen[iRb]].markers) {
+        markerClaimed[idx] = true;
+      }
     }
   }
-  
+  acquire(stamp, unclaimedMarkers(markers, markerClaimed), acquireRigidBodies);
+
   if (!m_inputPath.empty()) {
     std::string inputfileName = m_inputPath.substr(m_inputPath.find_last_of("/\\") + 1);
     std::string outputDir = "./data/output/";
     auto now = std::chrono::system_clock::now();
     auto epoch = now.time_since_epoch();
     auto minutes = std::chrono::duration_cast<std::chrono::minutes>(epoch).count();
-    // std::cout << "Minutes: " << minutes << std::endl;
     std::string outputFile = outputDir + inputfileName+"_"+ std::to_string(minutes);  // + inputFile
     outputFile = outputFile + ".txt";
     
@@ -1024,18 +1461,25 @@ void RigidBodyTracker::updateHybrid(std::chrono::high_resolution_clock::time_poi
       std::cout << "File does not exist, creating a new file..." << std::endl;
       out.open(outputFile);
     }
-    // out << "highLevelExpanded: " << m_highLevelExpanded << std::endl;
-    // out << "duplicate: " << duplicate << std::endl;
-    // out << "elapsedSeconds: " << elapsedSeconds << std::endl;  
     out << "stamp: " << stamp.time_since_epoch().count() << std::endl;
 
     std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();  
     std::chrono::duration<double> time_used = std::chrono::duration_cast<std::chrono::duration<double>>( t2-t1 );
     out << "Runtime: " << time_used.count() << " seconds" << std::endl;
+    HighLevelNode P;
+    P.id = 0;
+    P.cost = 0;
+    for (size_t iRb = 0; iRb < numRigidBodies; ++iRb) {
+      if (rbChosen[iRb] >= 0) {
+        const TrackingCandidate& candidate = rbCandidates[iRb][rbChosen[iRb]];
+        P.solution[std::to_string(iRb)] = taskSet(candidate);
+        P.cost += candidate.cost;
+      }
+    }
     out << P;
     
     out << "transformation:"<< std::endl;
-    for (int iRb = 0; iRb < numRigidBodies; ++iRb) {
+    for (size_t iRb = 0; iRb < numRigidBodies; ++iRb) {
       RigidBody& rigidBody = m_rigidBodies[iRb];
       Eigen::Quaternionf q(rigidBody.m_lastTransformation.rotation());
       out << iRb<< ": "  <<rigidBody.m_lastTransformation.translation().x()
@@ -1048,12 +1492,362 @@ void RigidBodyTracker::updateHybrid(std::chrono::high_resolution_clock::time_poi
       <<std::endl;
     }
   }
+}
+
+float RigidBodyTracker::maxInitialDeviation() const
+{
+  return m_maxInitialDeviation;
+}
+
+void RigidBodyTracker::acquire(
+  std::chrono::high_resolution_clock::time_point stamp,
+  Cloud::ConstPtr markers,
+  const std::vector<size_t>& rigidBodyIdxs)
+{
+  // only bodies whose backoff expired, longest waiting first
+  std::vector<size_t> due;
+  for (size_t iRb : rigidBodyIdxs) {
+    if (m_rigidBodies[iRb].m_nextInitAttempt <= m_frame) {
+      due.push_back(iRb);
+    }
+  }
+  std::stable_sort(due.begin(), due.end(), [this](size_t a, size_t b) {
+    return m_rigidBodies[a].m_nextInitAttempt < m_rigidBodies[b].m_nextInitAttempt;
+  });
+  if (due.size() > m_maxInitializationsPerFrame) {
+    due.resize(m_maxInitializationsPerFrame);
+  }
+  if (due.empty() || markers->empty()) {
+    return;
+  }
+
+  // the yaw search for multi-marker bodies may be moved to the background;
+  // those only count as attempted once a result came back
+  std::vector<size_t> attempted;
+  std::vector<size_t> inlineIdxs;
+  for (size_t iRb : due) {
+    RigidBody& rigidBody = m_rigidBodies[iRb];
+    rigidBody.m_initialized = false;
+    if (m_reacquisitionWorker && m_markerDescriptors[rigidBody.m_markerConfigurationIdx]->numMarkers > 1) {
+      if (acquireInBackground(stamp, markers, iRb)) {
+        attempted.push_back(iRb);
+      }
+    } else {
+      inlineIdxs.push_back(iRb);
+      attempted.push_back(iRb);
+    }
+  }
+
+  std::vector<size_t> positionIdxs;
+  std::vector<size_t> poseIdxs;
+  for (size_t iRb : inlineIdxs) {
+    if (m_rigidBodies[iRb].m_trackingMode == PositionMode) {
+      positionIdxs.push_back(iRb);
+    } else {
+      poseIdxs.push_back(iRb);
+    }
+  }
+  if (!positionIdxs.empty()) {
+    initializePosition(stamp, markers, positionIdxs);
+  }
+  if (!poseIdxs.empty()) {
+    initializePose(stamp, markers, poseIdxs);
+  }
+
+  size_t failed = 0;
+  for (size_t iRb : attempted) {
+    RigidBody& rigidBody = m_rigidBodies[iRb];
+    if (rigidBody.m_initialized) {
+      rigidBody.m_initAttempts = 0;
+      rigidBody.m_nextInitAttempt = 0;
+      continue;
+    }
+    // exponential backoff: retry after 1, 2, 4, ... 32 frames
+    ++rigidBody.m_initAttempts;
+    size_t const backoff = size_t(1) << std::min<size_t>(rigidBody.m_initAttempts - 1, 5);
+    rigidBody.m_nextInitAttempt = m_frame + backoff;
+    ++failed;
+  }
+
+  if (failed > 0) {
+    std::stringstream sstr;
+    sstr << "rigid body tracker initialization failed for " << failed
+         << " rigid bodies - "
+            "check that position is correct, all markers are visible, "
+            "and marker configuration matches config file";
+    logWarn(sstr.str());
+  }
+}
+
+// background results for older snapshots are searched again; matches the
+// longest re-initialization backoff
+static const size_t MaxHypothesisAgeFrames = 32;
+
+bool RigidBodyTracker::acquireInBackground(
+  std::chrono::high_resolution_clock::time_point stamp,
+  Cloud::ConstPtr markers,
+  size_t rigidBodyIdx)
+{
+  RigidBody& rigidBody = m_rigidBodies[rigidBodyIdx];
+  MarkerConfigurationDescriptorPtr desc = m_markerDescriptors[rigidBody.m_markerConfigurationIdx];
+  const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
+
+  PoseHypothesis hypothesis;
+  bool hasHypothesis = false;
+  {
+    std::lock_guard<std::mutex> lock(m_hypothesesMutex);
+    auto it = m_hypotheses.find(rigidBodyIdx);
+    if (it != m_hypotheses.end()) {
+      hypothesis = it->second;
+      m_hypotheses.erase(it);
+      hasHypothesis = true;
+    }
+  }
+
+  // a pose found on an old snapshot cannot be confirmed within the
+  // dynamics limits; search again on this frame instead
+  std::chrono::duration<double> hypothesisAge = stamp - hypothesis.stamp;
+  if (hasHypothesis && hypothesis.found
+      && (hypothesisAge.count() <= 0 || hypothesisAge.count() > dynConf.reinitTimeout
+          || m_frame - hypothesis.frame > MaxHypothesisAgeFrames)) {
+    std::stringstream sstr;
+    sstr << "background hypothesis for rigid body " << rigidBody.name()
+         << " is outdated, searching again";
+    logWarn(sstr.str());
+    hasHypothesis = false;
+  }
+
+  if (!hasHypothesis) {
+    if (m_reacquisitionWorker->busy(rigidBodyIdx)) {
+      return false;
+    }
+    // the worker searches on a snapshot of this frame's unclaimed markers
+    Eigen::Vector3f nominalCenter = rigidBody.center();
+    float maxDeviation = maxInitialDeviation();
+    double maxFitnessScore = dynConf.maxFitnessScore;
+    size_t frame = m_frame;
+    m_reacquisitionWorker->submit(rigidBodyIdx,
+      [this, rigidBodyIdx, stamp, frame, desc, markers, nominalCenter, maxDeviation, maxFitnessScore]() {
+        TaskScheduler scheduler(1);
+        KdTree::Ptr markerTree(new KdTree);
+        markerTree->setInputCloud(markers);
+        PoseHypothesis result;
+        result.stamp = stamp;
+        result.frame = frame;
+        std::string error;
+        result.found = searchPose(scheduler, *desc, markers, markerTree, nominalCenter,
+          maxDeviation, maxFitnessScore, result.transformation, error);
+        std::lock_guard<std::mutex> lock(m_hypothesesMutex);
+        m_hypotheses[rigidBodyIdx] = result;
+      });
+    return false;
+  }
+
+  if (!hypothesis.found) {
+    std::stringstream sstr;
+    sstr << "background search did not find rigid body " << rigidBody.name();
+    logWarn(sstr.str());
+    return true;
+  }
+
+  // Confirm the hypothesis cheaply with a single ICP run on the current
+  // frame, within the radius and dynamics limits of regular tracking. ICP
+  // has to settle; running into the iteration limit means the hypothesis
+  // is too far off.
+  double dt = hypothesisAge.count();
+  ICP icp;
+  icp.setMaximumIterations(10);
+  icp.setTransformationEpsilon(1e-6);
+  Eigen::Vector3f const limits = dt * Eigen::Vector3f(
+    dynConf.maxXVelocity, dynConf.maxYVelocity, dynConf.maxZVelocity);
+  icp.setMaxCorrespondenceDistance(maxMarkerDisplacement(dynConf, *desc, dt, limits.maxCoeff()));
+  icp.setInputSource(desc->points);
+  icp.setInputTarget(markers);
+  Cloud result;
+  icp.align(result, hypothesis.transformation.matrix());
+  std::stringstream violations;
+  if (!icp.hasSettled()
+      || !withinDynamics(dynConf, hypothesis.transformation, Eigen::Affine3f(icp.getFinalTransformation()),
+           dt, icp.getFitnessScore(), violations)) {
+    std::stringstream sstr;
+    sstr << "background hypothesis for rigid body " << rigidBody.name()
+         << " not confirmed by current frame" << std::endl
+         << violations.str();
+    logWarn(sstr.str());
+    return true;
+  }
+
+  rigidBody.m_lastTransformation = Eigen::Affine3f(icp.getFinalTransformation());
+  rigidBody.m_lastValidTransform = stamp;
+  rigidBody.m_lastTransformationValid = true;
+  rigidBody.m_hasOrientation = true;
+  rigidBody.m_initialized = true;
+  return true;
+}
 
+Cloud::ConstPtr RigidBodyTracker::prefilter(
+  std::chrono::high_resolution_clock::time_point stamp,
+  Cloud::ConstPtr pointCloud)
+{
+  if (!m_prefilter) {
+    m_prefilterStatistics = PrefilterStatistics();
+    m_prefilterStatistics.inputMarkers = pointCloud->size();
+    m_prefilterStatistics.outputMarkers = pointCloud->size();
+    return pointCloud;
+  }
+
+  // tracked bodies are gated around their predicted position, others
+  // around the area the initialization searches in
+  std::vector<MarkerPrefilter::Gate> gates;
+  gates.reserve(m_rigidBodies.size());
+  float const gatingDistance = m_prefilter->configuration().gatingDistance;
+  for (const RigidBody& rigidBody : m_rigidBodies) {
+    float const extent = m_markerDescriptors[rigidBody.m_markerConfigurationIdx]->radius;
+    MarkerPrefilter::Gate gate;
+    if (rigidBody.m_initialized && rigidBody.m_lastTransformationValid) {
+      const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
+      if (dynConf.useMotionFilter && rigidBody.m_motionFilter.initialized()) {
+        Eigen::Vector3f variance;
+        rigidBody.m_motionFilter.predict(stamp, dynConf.motionProcessNoise, gate.center, variance);
+      } else {
+        std::chrono::duration<double> elapsedSeconds = stamp - rigidBody.m_lastValidTransform;
+        gate.center = rigidBody.center() + rigidBody.m_velocity * elapsedSeconds.count();
+      }
+      gate.radius = extent + gatingDistance;
+    } else {
+      gate.center = rigidBody.center();
+      gate.radius = extent + std::max(gatingDistance, maxInitialDeviation());
+    }
+    gates.push_back(gate);
+  }
+
+  Cloud::Ptr filtered(new Cloud);
+  // ids only belong to the input of update(MarkerView)
+  static const std::vector<uint32_t> noIds;
+  const std::vector<uint32_t>& ids = m_inputIds.size() == pointCloud->size() ? m_inputIds : noIds;
+  m_prefilter->filter(pointCloud, ids, gates, *filtered, m_prefilterStatistics);
+  return filtered;
+}
+
+Cloud::Ptr RigidBodyTracker::unclaimedMarkers(
+  Cloud::ConstPtr markers,
+  const std::vector<bool>& markerClaimed) const
+{
+  Cloud::Ptr result(new Cloud);
+  for (size_t i = 0; i < markers->size(); ++i) {
+    if (!markerClaimed[i]) {
+      result->push_back((*markers)[i]);
+    }
+  }
+  return result;
+}
+
+void RigidBodyTracker::runPerRigidBody(const std::function<void(size_t)>& fn)
+{
+  std::vector<TaskScheduler::Task> tasks;
+  tasks.reserve(m_rigidBodies.size());
+  for (size_t iRb = 0; iRb < m_rigidBodies.size(); ++iRb) {
+    RigidBody& rigidBody = m_rigidBodies[iRb];
+    tasks.push_back({[&fn, &rigidBody, iRb]() {
+      auto start = std::chrono::steady_clock::now();
+      fn(iRb);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      rigidBody.m_updateCost = elapsed.count();
+    }, rigidBody.m_updateCost});
+  }
+  m_scheduler->run(tasks);
+}
+
+void RigidBodyTracker::notifyRigidBody(size_t rigidBodyIdx)
+{
+  if (m_notified[rigidBodyIdx]) {
+    return;
+  }
+  m_notified[rigidBodyIdx] = true;
+  updateMotionFilter(m_rigidBodies[rigidBodyIdx]);
+  updatePoseHistory(m_rigidBodies[rigidBodyIdx]);
+  if (m_rigidBodyCallback) {
+    m_rigidBodyCallback(rigidBodyIdx, m_rigidBodies[rigidBodyIdx]);
+  }
+}
+
+void RigidBodyTracker::updateMotionFilter(RigidBody& rigidBody)
+{
+  const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
+  MotionFilter& filter = rigidBody.m_motionFilter;
+  if (!dynConf.useMotionFilter
+      || !rigidBody.m_lastTransformationValid
+      || (filter.initialized() && filter.stamp() == rigidBody.m_lastValidTransform)) {
+    return;
+  }
+
+  std::chrono::duration<double> elapsedSeconds = rigidBody.m_lastValidTransform - filter.stamp();
+  if (!filter.initialized() || elapsedSeconds.count() > dynConf.reinitTimeout) {
+    // after (re-)acquisition, the velocity is only known to be within limits
+    Eigen::Vector3f maxVelocity(dynConf.maxXVelocity, dynConf.maxYVelocity, dynConf.maxZVelocity);
+    filter.reset(rigidBody.m_lastValidTransform, rigidBody.center(),
+      maxVelocity.cwiseProduct(maxVelocity), dynConf.measurementNoise);
+  } else {
+    filter.update(rigidBody.m_lastValidTransform, rigidBody.center(),
+      dynConf.motionProcessNoise, dynConf.measurementNoise);
+  }
+}
+
+void RigidBodyTracker::updatePoseHistory(RigidBody& rigidBody)
+{
+  if (!rigidBody.m_lastTransformationValid || !rigidBody.m_poseHistory) {
+    return;
+  }
+  const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
+  PoseHistory& history = *rigidBody.m_poseHistory;
+
+  PoseEstimate state;
+  state.stamp = rigidBody.m_lastValidTransform;
+  state.position = rigidBody.center();
+  state.hasOrientation = rigidBody.m_hasOrientation;
+  state.orientation = rigidBody.m_hasOrientation
+    ? Eigen::Quaternionf(rigidBody.m_lastTransformation.rotation())
+    : Eigen::Quaternionf::Identity();
+  state.velocity = Eigen::Vector3f::Zero();
+
+  PoseEstimate previous;
+  if (history.latest(previous)) {
+    if (previous.stamp >= state.stamp) {
+      return;
+    }
+    // after (re-)acquisition, the last velocity estimate is stale
+    std::chrono::duration<double> elapsedSeconds = state.stamp - previous.stamp;
+    if (elapsedSeconds.count() <= dynConf.reinitTimeout) {
+      const MotionFilter& filter = rigidBody.m_motionFilter;
+      state.velocity = dynConf.useMotionFilter && filter.initialized()
+        ? filter.velocity() : rigidBody.m_velocity;
+    }
+  }
+  history.push(state);
+}
+
+void RigidBodyTracker::resetPoseHistory(RigidBody& rigidBody)
+{
+  const DynamicsConfiguration& dynConf = m_dynamicsConfigurations[rigidBody.m_dynamicsConfigurationIdx];
+  rigidBody.m_poseHistory = std::make_shared<PoseHistory>(
+    dynConf.poseHistorySize, dynConf.maxExtrapolation);
+}
+
+bool RigidBodyTracker::poseAt(size_t rigidBodyIdx,
+  std::chrono::high_resolution_clock::time_point stamp,
+  PoseEstimate& pose) const
+{
+  if (rigidBodyIdx >= m_rigidBodies.size() || !m_rigidBodies[rigidBodyIdx].m_poseHistory) {
+    return false;
+  }
+  return m_rigidBodies[rigidBodyIdx].m_poseHistory->at(stamp, pose);
 }
 
 void RigidBodyTracker::logWarn(const std::string& msg)
 {
   if (m_logWarn) {
+    // may be called from several scheduler threads at once
+    std::lock_guard<std::mutex> lock(m_logWarnMutex);
     m_logWarn(msg);
   }
 }
@@ -0,0 +1,85 @@
+// Stand-in for the motion capture system: replays a point cloud recording
+// (see cloudlog.hpp for the format) as a UDP marker stream.
+#include "librigidbodytracker/udp_marker_stream.h"
+#include "marker_recording.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace librigidbodytracker;
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    std::cerr << "use arguments: <recording> [--host <host>] [--port <port>] [--rate <Hz>] [--loops <n>]\n"
+              << "  --rate: frames per second; 0 (default) replays at the recorded timing\n";
+    return -1;
+  }
+  std::string host = "127.0.0.1";
+  int port = 5555;
+  double rate = 0;
+  int loops = 1;
+  for (int i = 2; i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--host") {
+      host = argv[i + 1];
+    } else if (arg == "--port") {
+      port = std::stoi(argv[i + 1]);
+    } else if (arg == "--rate") {
+      rate = std::stod(argv[i + 1]);
+    } else if (arg == "--loops") {
+      loops = std::stoi(argv[i + 1]);
+    } else {
+      std::cerr << "unknown argument " << arg << "\n";
+      return -1;
+    }
+  }
+
+  std::vector<RecordedFrame> frames;
+  try {
+    frames = loadRecording(argv[1]);
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << "\n";
+    return -1;
+  }
+  if (frames.empty()) {
+    std::cerr << "empty recording\n";
+    return -1;
+  }
+
+  UdpMarkerSender sender(host, port);
+  std::cout << "sending " << frames.size() << " frames to " << host << ":" << port << "\n";
+
+  // stamps continue across loops, so the tracker sees a steady stream
+  uint32_t const duration = frames.back().millis - frames.front().millis + 1;
+  size_t sent = 0;
+  size_t failed = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int loop = 0; loop < loops; ++loop) {
+    for (size_t i = 0; i < frames.size(); ++i) {
+      const RecordedFrame& frame = frames[i];
+      std::chrono::milliseconds millis(loop * duration + frame.millis - frames.front().millis);
+      if (rate > 0) {
+        std::this_thread::sleep_until(start + std::chrono::duration<double>(sent / rate));
+      } else {
+        std::this_thread::sleep_until(start + millis);
+      }
+      MarkerView markers(frame.markers.data(), frame.markers.size() / 3);
+      std::chrono::high_resolution_clock::time_point stamp(rate > 0
+        ? std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+            std::chrono::duration<double>(sent / rate))
+        : std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(millis));
+      if (!sender.send(stamp, markers)) {
+        ++failed;
+      }
+      ++sent;
+    }
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << sent << " frames in " << elapsed.count() << " s, " << failed << " failed\n";
+}
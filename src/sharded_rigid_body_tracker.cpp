@@ -0,0 +1,207 @@
+#include "librigidbodytracker/sharded_rigid_body_tracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "librigidbodytracker/pose_channel.h"
+#include "task_scheduler.hpp"
+
+using Point = librigidbodytracker::PointXYZ;
+using Cloud = librigidbodytracker::PointCloud;
+
+namespace librigidbodytracker {
+
+ShardedRigidBodyTracker::ShardedRigidBodyTracker(
+  const ShardConfiguration& shardConfiguration,
+  const std::vector<DynamicsConfiguration>& dynamicsConfigurations,
+  const std::vector<MarkerConfiguration>& markerConfigurations,
+  const std::vector<RigidBody>& rigidBodies)
+  : m_shardConfiguration(shardConfiguration)
+  , m_shards()
+  , m_scheduler()
+  , m_rigidBodies(rigidBodies)
+  , m_logWarn()
+{
+  if (m_shardConfiguration.numShardsX == 0 || m_shardConfiguration.numShardsY == 0) {
+    throw std::runtime_error("ShardedRigidBodyTracker: need at least one shard per axis.");
+  }
+
+  size_t const numShards = m_shardConfiguration.numShardsX * m_shardConfiguration.numShardsY;
+  std::vector<std::vector<RigidBody>> shardRigidBodies(numShards);
+  m_shards.resize(numShards);
+  for (size_t i = 0; i < m_rigidBodies.size(); ++i) {
+    size_t s = shardIndex(m_rigidBodies[i].initialCenter());
+    shardRigidBodies[s].push_back(m_rigidBodies[i]);
+    m_shards[s].rigidBodyIds.push_back(i);
+  }
+
+  for (size_t s = 0; s < numShards; ++s) {
+    m_shards[s].tracker.reset(new RigidBodyTracker(
+      dynamicsConfigurations, markerConfigurations, shardRigidBodies[s]));
+    m_shards[s].markers.reset(new Cloud);
+    m_shards[s].updateCost = 0;
+    // pose histories are created by the shards; expose them right away
+    const std::vector<RigidBody>& local = m_shards[s].tracker->rigidBodies();
+    for (size_t j = 0; j < local.size(); ++j) {
+      m_rigidBodies[m_shards[s].rigidBodyIds[j]].m_poseHistory = local[j].m_poseHistory;
+    }
+  }
+
+  // the workers live as long as the tracker; the calling thread is one of them
+  m_scheduler.reset(new TaskScheduler(numShards));
+}
+
+ShardedRigidBodyTracker::~ShardedRigidBodyTracker() = default;
+
+void ShardedRigidBodyTracker::update(Cloud::Ptr pointCloud)
+{
+  update(std::chrono::high_resolution_clock::now(), pointCloud);
+}
+
+void ShardedRigidBodyTracker::update(
+  std::chrono::high_resolution_clock::time_point stamp,
+  Cloud::ConstPtr pointCloud)
+{
+  routeMarkers(pointCloud);
+
+  std::vector<TaskScheduler::Task> tasks;
+  tasks.reserve(m_shards.size());
+  for (Shard& shard : m_shards) {
+    tasks.push_back({[&shard, stamp]() {
+      auto start = std::chrono::steady_clock::now();
+      shard.tracker->update(stamp, shard.markers);
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+      shard.updateCost = elapsed.count();
+    }, shard.updateCost});
+  }
+  m_scheduler->run(tasks);
+
+  for (const Shard& shard : m_shards) {
+    const std::vector<RigidBody>& local = shard.tracker->rigidBodies();
+    for (size_t j = 0; j < local.size(); ++j) {
+      m_rigidBodies[shard.rigidBodyIds[j]] = local[j];
+    }
+  }
+
+  handOff();
+
+  if (m_posePublisher) {
+    m_posePublisher->publish(stamp, m_rigidBodies);
+  }
+}
+
+const std::vector<RigidBody>& ShardedRigidBodyTracker::rigidBodies() const
+{
+  return m_rigidBodies;
+}
+
+void ShardedRigidBodyTracker::setPosePublisher(std::shared_ptr<PosePublisher> publisher)
+{
+  m_posePublisher = publisher;
+}
+
+void ShardedRigidBodyTracker::setLogWarningCallback(
+  std::function<void(const std::string&)> logWarn)
+{
+  m_logWarn = logWarn;
+  for (size_t s = 0; s < m_shards.size(); ++s) {
+    if (!logWarn) {
+      m_shards[s].tracker->setLogWarningCallback(logWarn);
+      continue;
+    }
+    // shards run concurrently, so serialize calls into the user callback
+    m_shards[s].tracker->setLogWarningCallback([this, s](const std::string& msg) {
+      std::lock_guard<std::mutex> lock(m_logWarnMutex);
+      std::stringstream sstr;
+      sstr << "[shard " << s << "] " << msg;
+      m_logWarn(sstr.str());
+    });
+  }
+}
+
+size_t ShardedRigidBodyTracker::cellX(float x) const
+{
+  const ShardConfiguration& cfg = m_shardConfiguration;
+  float width = (cfg.upperBound.x() - cfg.lowerBound.x()) / cfg.numShardsX;
+  float cell = std::floor((x - cfg.lowerBound.x()) / width);
+  return std::min<float>(std::max<float>(cell, 0), cfg.numShardsX - 1);
+}
+
+size_t ShardedRigidBodyTracker::cellY(float y) const
+{
+  const ShardConfiguration& cfg = m_shardConfiguration;
+  float width = (cfg.upperBound.y() - cfg.lowerBound.y()) / cfg.numShardsY;
+  float cell = std::floor((y - cfg.lowerBound.y()) / width);
+  return std::min<float>(std::max<float>(cell, 0), cfg.numShardsY - 1);
+}
+
+size_t ShardedRigidBodyTracker::shardIndex(const Eigen::Vector3f& position) const
+{
+  return cellY(position.y()) * m_shardConfiguration.numShardsX + cellX(position.x());
+}
+
+void ShardedRigidBodyTracker::routeMarkers(Cloud::ConstPtr pointCloud)
+{
+  for (Shard& shard : m_shards) {
+    shard.markers->clear();
+  }
+
+  float const overlap = m_shardConfiguration.overlap;
+  for (const Point& p : *pointCloud) {
+    size_t xLow = cellX(p.x - overlap);
+    size_t xHigh = cellX(p.x + overlap);
+    size_t yLow = cellY(p.y - overlap);
+    size_t yHigh = cellY(p.y + overlap);
+    for (size_t y = yLow; y <= yHigh; ++y) {
+      for (size_t x = xLow; x <= xHigh; ++x) {
+        m_shards[y * m_shardConfiguration.numShardsX + x].markers->push_back(p);
+      }
+    }
+  }
+}
+
+void ShardedRigidBodyTracker::handOff()
+{
+  // like addRigidBody()/removeRigidBody(), but without resetting the pose
+  // history; take the update lock of every shard (always in the same order)
+  // so a hand-off never interleaves with an update of a shard
+  std::vector<std::unique_lock<std::mutex>> locks;
+  locks.reserve(m_shards.size());
+  for (Shard& shard : m_shards) {
+    locks.emplace_back(shard.tracker->m_updateMutex);
+  }
+
+  std::vector<bool> changed(m_shards.size(), false);
+  for (size_t s = 0; s < m_shards.size(); ++s) {
+    Shard& shard = m_shards[s];
+    std::vector<RigidBody>& local = shard.tracker->m_rigidBodies;
+    for (size_t j = 0; j < local.size();) {
+      // only hand off bodies with a current estimate; lost bodies stay
+      // with their shard until they are found again
+      size_t t = shardIndex(local[j].center());
+      if (t == s || !local[j].m_lastTransformationValid) {
+        ++j;
+        continue;
+      }
+
+      Shard& target = m_shards[t];
+      target.tracker->m_rigidBodies.push_back(local[j]);
+      target.rigidBodyIds.push_back(shard.rigidBodyIds[j]);
+      local.erase(local.begin() + j);
+      shard.rigidBodyIds.erase(shard.rigidBodyIds.begin() + j);
+      changed[s] = true;
+      changed[t] = true;
+    }
+  }
+
+  for (size_t s = 0; s < m_shards.size(); ++s) {
+    if (changed[s]) {
+      m_shards[s].tracker->updateTrackingMode();
+      m_shards[s].tracker->discardHypotheses();
+    }
+  }
+}
+
+} // namespace librigidbodytracker
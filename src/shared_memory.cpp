@@ -0,0 +1,89 @@
+#include "shared_memory.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace librigidbodytracker {
+
+namespace {
+
+  [[noreturn]] void fail(const std::string& what, const std::string& name)
+  {
+    throw std::runtime_error("SharedMemory: " + what + " " + name + ": " + std::strerror(errno));
+  }
+
+} // anonymous namespace
+
+SharedMemory::SharedMemory(const std::string& name, size_t size)
+  : m_name(name)
+  , m_data(nullptr)
+  , m_size(size)
+  , m_owner(true)
+{
+  // readers of a previous run keep their (orphaned) mapping
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    fail("cannot create", name);
+  }
+  if (ftruncate(fd, size) != 0) {
+    int error = errno;
+    close(fd);
+    shm_unlink(name.c_str());
+    errno = error;
+    fail("cannot resize", name);
+  }
+  map(fd, true);
+}
+
+SharedMemory::SharedMemory(const std::string& name, bool writable)
+  : m_name(name)
+  , m_data(nullptr)
+  , m_size(0)
+  , m_owner(false)
+{
+  int fd = shm_open(name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+  if (fd < 0) {
+    fail("cannot open", name);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    fail("cannot stat", name);
+  }
+  m_size = st.st_size;
+  map(fd, writable);
+}
+
+void SharedMemory::map(int fd, bool writable)
+{
+  void* data = mmap(nullptr, m_size,
+    writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  int error = errno;
+  // the mapping keeps the segment alive
+  close(fd);
+  if (data == MAP_FAILED) {
+    if (m_owner) {
+      shm_unlink(m_name.c_str());
+    }
+    errno = error;
+    fail("cannot map", m_name);
+  }
+  m_data = data;
+}
+
+SharedMemory::~SharedMemory()
+{
+  munmap(m_data, m_size);
+  if (m_owner) {
+    shm_unlink(m_name.c_str());
+  }
+}
+
+} // namespace librigidbodytracker
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace librigidbodytracker {
+
+/*! \brief POSIX shared memory segment, mapped for the lifetime of the object
+
+The creating side owns the name and unlinks it on destruction; processes that
+still have the segment mapped keep working on it. Throws std::runtime_error
+if the segment cannot be created, opened, or mapped.
+*/
+class SharedMemory
+{
+public:
+  // Creates a zero-filled segment, replacing a stale one of the same name.
+  // name follows shm_open(), e.g., "/rigid_body_poses".
+  SharedMemory(const std::string& name, size_t size);
+
+  // Opens an existing segment, mapping all of it.
+  SharedMemory(const std::string& name, bool writable);
+
+  ~SharedMemory();
+
+  SharedMemory(const SharedMemory&) = delete;
+  SharedMemory& operator=(const SharedMemory&) = delete;
+
+  void* data() const { return m_data; }
+  size_t size() const { return m_size; }
+  const std::string& name() const { return m_name; }
+
+private:
+  void map(int fd, bool writable);
+
+private:
+  std::string m_name;
+  void* m_data;
+  size_t m_size;
+  bool m_owner;
+};
+
+} // namespace librigidbodytracker
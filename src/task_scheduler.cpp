@@ -0,0 +1,159 @@
+#include "task_scheduler.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+namespace librigidbodytracker {
+
+namespace {
+  thread_local const TaskScheduler* tl_scheduler = nullptr;
+  thread_local size_t tl_workerIndex = 0;
+}
+
+TaskScheduler::TaskScheduler(size_t numThreads)
+  : m_queues()
+  , m_threads()
+  , m_pending(0)
+  , m_stop(false)
+{
+  numThreads = std::max<size_t>(numThreads, 1);
+  for (size_t i = 0; i < numThreads; ++i) {
+    m_queues.emplace_back(new Queue);
+  }
+  // worker 0 is whichever thread calls run()
+  for (size_t i = 1; i < numThreads; ++i) {
+    m_threads.emplace_back(&TaskScheduler::workerLoop, this, i);
+  }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (auto& t : m_threads) {
+    t.join();
+  }
+}
+
+void TaskScheduler::run(std::vector<Task>& tasks)
+{
+  if (tasks.empty()) {
+    return;
+  }
+
+  if (m_threads.empty()) {
+    for (auto& task : tasks) {
+      task.fn();
+    }
+    return;
+  }
+
+  Batch batch;
+  batch.remaining = tasks.size();
+
+  // longest processing time first: hand the most expensive remaining task
+  // to the worker with the lowest predicted load
+  std::vector<size_t> order(tasks.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&tasks](size_t a, size_t b) {
+    return tasks[a].costHint > tasks[b].costHint;
+  });
+  std::vector<double> load(m_queues.size(), 0);
+  std::vector<std::vector<QueuedTask>> assigned(m_queues.size());
+  for (size_t idx : order) {
+    size_t w = std::min_element(load.begin(), load.end()) - load.begin();
+    load[w] += std::max(tasks[idx].costHint, 1e-9);
+    assigned[w].push_back({&tasks[idx].fn, &batch});
+  }
+  // count before publishing, so m_pending never drops below zero
+  m_pending += tasks.size();
+  for (size_t w = 0; w < m_queues.size(); ++w) {
+    std::lock_guard<std::mutex> lock(m_queues[w]->mutex);
+    for (const auto& t : assigned[w]) {
+      m_queues[w]->tasks.push_back(t);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_wake.notify_all();
+    // threads blocked in a nested run() may help as well
+    m_done.notify_all();
+  }
+
+  size_t const self = currentWorker();
+  while (batch.remaining > 0) {
+    QueuedTask task;
+    if (popOrSteal(self, task)) {
+      execute(task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+    m_done.wait(lock, [&]() {
+      return batch.remaining == 0 || m_pending > 0;
+    });
+  }
+}
+
+void TaskScheduler::workerLoop(size_t index)
+{
+  tl_scheduler = this;
+  tl_workerIndex = index;
+  while (true) {
+    QueuedTask task;
+    if (popOrSteal(index, task)) {
+      execute(task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+    m_wake.wait(lock, [this]() {
+      return m_stop || m_pending > 0;
+    });
+    if (m_stop) {
+      return;
+    }
+  }
+}
+
+size_t TaskScheduler::currentWorker() const
+{
+  return tl_scheduler == this ? tl_workerIndex : 0;
+}
+
+bool TaskScheduler::popOrSteal(size_t index, QueuedTask& task)
+{
+  {
+    Queue& own = *m_queues[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = own.tasks.front();
+      own.tasks.pop_front();
+      --m_pending;
+      return true;
+    }
+  }
+  for (size_t i = 1; i < m_queues.size(); ++i) {
+    Queue& victim = *m_queues[(index + i) % m_queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = victim.tasks.back();
+      victim.tasks.pop_back();
+      --m_pending;
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskScheduler::execute(const QueuedTask& task)
+{
+  (*task.fn)();
+  if (--task.batch->remaining == 0) {
+    std::lock_guard<std::mutex> lock(m_wakeMutex);
+    m_done.notify_all();
+  }
+}
+
+} // namespace librigidbodytracker
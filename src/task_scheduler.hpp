@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace librigidbodytracker {
+
+/*! \brief Work-stealing scheduler for short-lived, heterogeneous tasks
+
+Each worker owns a deque of tasks. A batch of tasks is distributed
+longest-processing-time first, using the cost hints, such that the predicted
+load of all workers is balanced. Workers pop their own tasks from the front
+(most expensive first) and steal from the back of other deques once they
+run dry, which absorbs wrong cost hints.
+
+The thread calling run() participates as worker 0, so a scheduler with a
+single thread executes everything inline. Tasks may call run() recursively
+(e.g. a per-body task spawning per-seed tasks); the waiting thread keeps
+executing pending tasks in the meantime.
+*/
+class TaskScheduler
+{
+public:
+  struct Task
+  {
+    std::function<void()> fn;
+    // expected runtime in arbitrary (but consistent) units
+    double costHint;
+  };
+
+  explicit TaskScheduler(size_t numThreads);
+  ~TaskScheduler();
+
+  TaskScheduler(const TaskScheduler&) = delete;
+  TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+  size_t numThreads() const { return m_queues.size(); }
+
+  // executes all tasks and returns once all of them are finished
+  void run(std::vector<Task>& tasks);
+
+private:
+  struct Batch
+  {
+    std::atomic<size_t> remaining;
+  };
+
+  struct QueuedTask
+  {
+    std::function<void()>* fn;
+    Batch* batch;
+  };
+
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<QueuedTask> tasks;
+  };
+
+  void workerLoop(size_t index);
+  size_t currentWorker() const;
+  bool popOrSteal(size_t index, QueuedTask& task);
+  void execute(const QueuedTask& task);
+
+private:
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_threads;
+  std::mutex m_wakeMutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  std::atomic<size_t> m_pending;
+  bool m_stop;
+};
+
+} // namespace librigidbodytracker
@@ -0,0 +1,113 @@
+// Tracks rigid bodies in the marker frames of a shared memory marker channel
+// (e.g., fed by replaymarkers) or of a UDP marker stream (e.g., fed by
+// sendmarkers), and reports the per-frame update time.
+#include "librigidbodytracker/rigid_body_tracker.h"
+#include "librigidbodytracker/configuration.h"
+#include "librigidbodytracker/marker_channel.h"
+#include "librigidbodytracker/udp_marker_stream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace librigidbodytracker;
+
+static void log_stderr(std::string s)
+{
+  std::cout << s << "\n";
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    std::cerr << "use arguments: <cfg> [<channel> | --udp <port>]\n";
+    return -1;
+  }
+  std::string channelName = "/librigidbodytracker_markers";
+  int udpPort = -1;
+  if (argc > 3 && std::string(argv[2]) == "--udp") {
+    udpPort = std::stoi(argv[3]);
+  } else if (argc > 2) {
+    channelName = argv[2];
+  }
+
+  TrackerConfiguration configuration;
+  try {
+    configuration = loadConfiguration(argv[1]);
+  } catch (const std::runtime_error& e) {
+    std::cerr << "invalid configuration: " << e.what() << "\n";
+    return -1;
+  }
+  RigidBodyTracker tracker(
+    configuration.dynamicsConfigurations,
+    configuration.markerConfigurations,
+    configuration.rigidBodies);
+  tracker.setLogWarningCallback(&log_stderr);
+  if (configuration.usePrefilter) {
+    tracker.setPrefilterConfiguration(configuration.prefilter);
+  }
+
+  std::unique_ptr<MarkerChannelConsumer> channel;
+  std::unique_ptr<UdpMarkerReceiver> receiver;
+  try {
+    if (udpPort >= 0) {
+      receiver.reset(new UdpMarkerReceiver(udpPort, 4096));
+    } else {
+      channel.reset(new MarkerChannelConsumer(channelName));
+    }
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << (receiver ? "" : " (start the producer first)") << "\n";
+    return -1;
+  }
+
+  // stop once the producer was idle for a while
+  size_t frames = 0;
+  double totalTime = 0;
+  double maxTime = 0;
+  auto lastFrame = std::chrono::steady_clock::now();
+  auto track = [&](std::chrono::high_resolution_clock::time_point stamp, const MarkerView& markers) {
+    auto start = std::chrono::steady_clock::now();
+    tracker.update(stamp, markers);
+    lastFrame = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = lastFrame - start;
+    totalTime += elapsed.count();
+    maxTime = std::max(maxTime, elapsed.count());
+    ++frames;
+  };
+  // a UDP stream has no start; wait for the first frame indefinitely
+  while (std::chrono::steady_clock::now() - lastFrame < std::chrono::seconds(2)
+      || (receiver && frames == 0)) {
+    if (receiver) {
+      receiver->receive(std::chrono::milliseconds(100), track);
+      continue;
+    }
+    std::chrono::high_resolution_clock::time_point stamp;
+    MarkerView markers(nullptr, 0);
+    if (!channel->peek(stamp, markers)) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+    track(stamp, markers);
+    channel->release();
+  }
+
+  if (receiver) {
+    const UdpReceiverStatistics& stats = receiver->statistics();
+    std::cout << frames << " frames, " << stats.droppedFrames << " dropped, "
+              << stats.datagrams << " datagrams (" << stats.reorderedDatagrams << " reordered, "
+              << stats.lateDatagrams << " late, " << stats.malformedDatagrams << " malformed)\n";
+  } else {
+    std::cout << frames << " frames, " << channel->droppedCount() << " dropped by the producer\n";
+  }
+  if (frames > 0) {
+    std::cout << "update time: mean " << 1000 * totalTime / frames
+              << " ms, max " << 1000 * maxTime << " ms\n";
+  }
+  for (const RigidBody& rigidBody : tracker.rigidBodies()) {
+    std::cout << rigidBody.name() << ": " << (rigidBody.lastTransformationValid() ? "valid" : "lost")
+              << " at " << rigidBody.center().transpose() << "\n";
+  }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cmath>
+
+#include <Eigen/Geometry>
+
+namespace librigidbodytracker {
+
+// rotation yaw * pitch * roll about the fixed z, y and x axes
+inline Eigen::Affine3f getTransformation(
+  float x, float y, float z, float roll, float pitch, float yaw)
+{
+  return Eigen::Translation3f(x, y, z)
+    * Eigen::AngleAxisf(yaw, Eigen::Vector3f::UnitZ())
+    * Eigen::AngleAxisf(pitch, Eigen::Vector3f::UnitY())
+    * Eigen::AngleAxisf(roll, Eigen::Vector3f::UnitX());
+}
+
+// inverse of getTransformation()
+inline void getTranslationAndEulerAngles(const Eigen::Affine3f& t,
+  float& x, float& y, float& z, float& roll, float& pitch, float& yaw)
+{
+  x = t(0, 3);
+  y = t(1, 3);
+  z = t(2, 3);
+  roll = std::atan2(t(2, 1), t(2, 2));
+  pitch = std::asin(-t(2, 0));
+  yaw = std::atan2(t(1, 0), t(0, 0));
+}
+
+} // namespace librigidbodytracker
@@ -0,0 +1,376 @@
+#include "librigidbodytracker/udp_marker_stream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "librigidbodytracker/rigid_body_tracker.h"
+
+namespace librigidbodytracker {
+
+namespace {
+
+  const char MarkerDatagramMagic[4] = {'L', 'R', 'B', 'U'};
+
+  // largest possible UDP payload
+  const size_t MaxDatagramSize = 65507;
+
+  // frame buffers; more than two frames in flight only happens with heavy
+  // reordering
+  const size_t NumAssemblies = 4;
+
+  // A datagram this many frames behind the last delivered frame, or this
+  // many late datagrams in a row, means the sender restarted its frame
+  // numbering rather than that the network reordered datagrams.
+  const uint32_t ResyncFrameWindow = 256;
+  const size_t ResyncLateDatagrams = 32;
+
+  [[noreturn]] void fail(const std::string& context, const std::string& what)
+  {
+    throw std::runtime_error(context + ": " + what + ": " + std::strerror(errno));
+  }
+
+  // true if frame number a comes after b, robust to wrap-around
+  bool isNewer(uint32_t a, uint32_t b)
+  {
+    return static_cast<int32_t>(a - b) > 0;
+  }
+
+} // anonymous namespace
+
+UdpMarkerSender::UdpMarkerSender(const std::string& host, uint16_t port, size_t maxDatagramSize)
+  : m_socket(-1)
+  , m_markersPerDatagram(0)
+  , m_frameNumber(0)
+  , m_buffer()
+{
+  maxDatagramSize = std::min(maxDatagramSize, MaxDatagramSize);
+  if (maxDatagramSize < sizeof(MarkerDatagramHeader) + 3 * sizeof(float)) {
+    throw std::runtime_error("UdpMarkerSender: datagrams too small for a single marker.");
+  }
+  m_markersPerDatagram = (maxDatagramSize - sizeof(MarkerDatagramHeader)) / (3 * sizeof(float));
+  m_buffer.resize(MaxFragmentsPerFrame * maxDatagramSize);
+
+  addrinfo hints;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* address = nullptr;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &address) != 0 || !address) {
+    throw std::runtime_error("UdpMarkerSender: cannot resolve " + host + ".");
+  }
+  m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+  // connected, so that fragments need no destination
+  if (m_socket < 0 || connect(m_socket, address->ai_addr, address->ai_addrlen) != 0) {
+    int error = errno;
+    freeaddrinfo(address);
+    if (m_socket >= 0) {
+      close(m_socket);
+    }
+    errno = error;
+    fail("UdpMarkerSender", "cannot connect to " + host);
+  }
+  freeaddrinfo(address);
+}
+
+UdpMarkerSender::~UdpMarkerSender()
+{
+  close(m_socket);
+}
+
+bool UdpMarkerSender::send(std::chrono::high_resolution_clock::time_point stamp, const MarkerView& markers)
+{
+  size_t const fragmentCount = std::max<size_t>(1,
+    (markers.count + m_markersPerDatagram - 1) / m_markersPerDatagram);
+  if (fragmentCount > MaxFragmentsPerFrame) {
+    return false;
+  }
+
+  size_t const datagramSize = sizeof(MarkerDatagramHeader) + m_markersPerDatagram * 3 * sizeof(float);
+  mmsghdr messages[MaxFragmentsPerFrame];
+  iovec vectors[MaxFragmentsPerFrame];
+  std::memset(messages, 0, sizeof(mmsghdr) * fragmentCount);
+
+  MarkerDatagramHeader header;
+  std::memcpy(header.magic, MarkerDatagramMagic, sizeof(MarkerDatagramMagic));
+  header.version = MarkerDatagramVersion;
+  header.fragmentCount = fragmentCount;
+  header.frameNumber = m_frameNumber++;
+  header.stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    stamp.time_since_epoch()).count();
+  header.numMarkers = markers.count;
+
+  for (size_t f = 0; f < fragmentCount; ++f) {
+    uint8_t* datagram = m_buffer.data() + f * datagramSize;
+    size_t const first = f * m_markersPerDatagram;
+    size_t const count = std::min(m_markersPerDatagram, markers.count - std::min(first, markers.count));
+    header.fragmentIndex = f;
+    header.markersInFragment = count;
+    header.firstMarker = first;
+    std::memcpy(datagram, &header, sizeof(header));
+    float* xyz = reinterpret_cast<float*>(datagram + sizeof(header));
+    for (size_t i = 0; i < count; ++i) {
+      std::memcpy(xyz + 3 * i, markers.marker(first + i), 3 * sizeof(float));
+    }
+    vectors[f].iov_base = datagram;
+    vectors[f].iov_len = sizeof(header) + count * 3 * sizeof(float);
+    messages[f].msg_hdr.msg_iov = &vectors[f];
+    messages[f].msg_hdr.msg_iovlen = 1;
+  }
+
+  size_t sent = 0;
+  while (sent < fragmentCount) {
+    int result = sendmmsg(m_socket, messages + sent, fragmentCount - sent, 0);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    sent += result;
+  }
+  return true;
+}
+
+/////////////////////////////////////////////////////////////
+
+struct UdpMarkerReceiver::Batch
+{
+  std::vector<uint8_t> buffers;
+  std::vector<mmsghdr> messages;
+  std::vector<iovec> vectors;
+};
+
+UdpMarkerReceiver::UdpMarkerReceiver(uint16_t port, size_t maxMarkers,
+  const std::string& bindAddress, size_t batchSize)
+  : m_socket(-1)
+  , m_maxMarkers(maxMarkers)
+  , m_batch(new Batch)
+  , m_assemblies(NumAssemblies)
+  , m_anyDelivered(false)
+  , m_lastDelivered(0)
+  , m_lastDeliveredStamp(0)
+  , m_consecutiveLate(0)
+  , m_anyReceived(false)
+  , m_newestReceived(0)
+  , m_statistics()
+{
+  batchSize = std::max<size_t>(batchSize, 1);
+  m_batch->buffers.resize(batchSize * MaxDatagramSize);
+  m_batch->messages.resize(batchSize);
+  m_batch->vectors.resize(batchSize);
+  for (size_t i = 0; i < batchSize; ++i) {
+    m_batch->vectors[i].iov_base = m_batch->buffers.data() + i * MaxDatagramSize;
+    m_batch->vectors[i].iov_len = MaxDatagramSize;
+  }
+  for (Assembly& assembly : m_assemblies) {
+    assembly.used = false;
+    assembly.markers.reserve(3 * maxMarkers);
+  }
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  if (inet_pton(AF_INET, bindAddress.c_str(), &address.sin_addr) != 1) {
+    throw std::runtime_error("UdpMarkerReceiver: invalid address " + bindAddress + ".");
+  }
+
+  m_socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (m_socket < 0) {
+    fail("UdpMarkerReceiver", "cannot create socket");
+  }
+  int reuse = 1;
+  setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  // room for a few frames if the tracker stalls; the kernel may clamp this
+  int bufferSize = 4 * 1024 * 1024;
+  setsockopt(m_socket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+  if (bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+    int error = errno;
+    close(m_socket);
+    errno = error;
+    fail("UdpMarkerReceiver", "cannot bind to port " + std::to_string(port));
+  }
+}
+
+UdpMarkerReceiver::~UdpMarkerReceiver()
+{
+  close(m_socket);
+}
+
+size_t UdpMarkerReceiver::receive(std::chrono::milliseconds timeout, RigidBodyTracker& tracker)
+{
+  return receive(timeout, [&tracker](
+    std::chrono::high_resolution_clock::time_point stamp, const MarkerView& markers) {
+    tracker.update(stamp, markers);
+  });
+}
+
+size_t UdpMarkerReceiver::receive(std::chrono::milliseconds timeout, const FrameCallback& onFrame)
+{
+  pollfd fd;
+  fd.fd = m_socket;
+  fd.events = POLLIN;
+  if (poll(&fd, 1, timeout.count()) <= 0) {
+    return 0;
+  }
+
+  size_t delivered = 0;
+  size_t const batchSize = m_batch->messages.size();
+  while (true) {
+    for (size_t i = 0; i < batchSize; ++i) {
+      std::memset(&m_batch->messages[i].msg_hdr, 0, sizeof(msghdr));
+      m_batch->messages[i].msg_hdr.msg_iov = &m_batch->vectors[i];
+      m_batch->messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int received = recvmmsg(m_socket, m_batch->messages.data(), batchSize, MSG_DONTWAIT, nullptr);
+    if (received <= 0) {
+      break;
+    }
+    for (int i = 0; i < received; ++i) {
+      const mmsghdr& message = m_batch->messages[i];
+      if (message.msg_hdr.msg_flags & MSG_TRUNC) {
+        ++m_statistics.datagrams;
+        ++m_statistics.malformedDatagrams;
+        continue;
+      }
+      handleDatagram(static_cast<const uint8_t*>(m_batch->vectors[i].iov_base),
+        message.msg_len, delivered, onFrame);
+    }
+    if (static_cast<size_t>(received) < batchSize) {
+      break;
+    }
+  }
+  return delivered;
+}
+
+void UdpMarkerReceiver::handleDatagram(const uint8_t* data, size_t size,
+  size_t& delivered, const FrameCallback& onFrame)
+{
+  ++m_statistics.datagrams;
+  MarkerDatagramHeader header;
+  if (size < sizeof(header)) {
+    ++m_statistics.malformedDatagrams;
+    return;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, MarkerDatagramMagic, sizeof(MarkerDatagramMagic)) != 0
+      || header.version != MarkerDatagramVersion
+      || header.fragmentCount == 0
+      || header.fragmentCount > MaxFragmentsPerFrame
+      || header.fragmentIndex >= header.fragmentCount
+      || size != sizeof(header) + header.markersInFragment * 3 * sizeof(float)
+      || header.numMarkers > m_maxMarkers
+      || size_t(header.firstMarker) + header.markersInFragment > header.numMarkers) {
+    ++m_statistics.malformedDatagrams;
+    return;
+  }
+
+  uint32_t const frameNumber = header.frameNumber;
+  if (m_anyDelivered && !isNewer(frameNumber, m_lastDelivered)) {
+    // a restarted sender counts from zero again, with newer stamps
+    if (m_lastDelivered - frameNumber > ResyncFrameWindow
+        || header.stamp > m_lastDeliveredStamp
+        || ++m_consecutiveLate >= ResyncLateDatagrams) {
+      resync();
+    } else {
+      ++m_statistics.lateDatagrams;
+      return;
+    }
+  }
+  m_consecutiveLate = 0;
+  if (m_anyReceived && isNewer(m_newestReceived, frameNumber)) {
+    ++m_statistics.reorderedDatagrams;
+  } else {
+    m_newestReceived = frameNumber;
+    m_anyReceived = true;
+  }
+
+  Assembly& assembly = assemblyFor(header);
+  uint64_t const fragment = uint64_t(1) << header.fragmentIndex;
+  if (assembly.numMarkers != header.numMarkers
+      || assembly.fragmentCount != header.fragmentCount
+      || (assembly.receivedFragments & fragment)) {
+    ++m_statistics.malformedDatagrams;
+    return;
+  }
+  std::memcpy(assembly.markers.data() + 3 * header.firstMarker,
+    data + sizeof(header), header.markersInFragment * 3 * sizeof(float));
+  assembly.receivedFragments |= fragment;
+
+  uint64_t const complete = assembly.fragmentCount == 64
+    ? ~uint64_t(0) : (uint64_t(1) << assembly.fragmentCount) - 1;
+  if (assembly.receivedFragments == complete) {
+    deliver(assembly, delivered, onFrame);
+  }
+}
+
+UdpMarkerReceiver::Assembly& UdpMarkerReceiver::assemblyFor(const MarkerDatagramHeader& header)
+{
+  Assembly* target = nullptr;
+  for (Assembly& assembly : m_assemblies) {
+    if (assembly.used && assembly.frameNumber == header.frameNumber) {
+      return assembly;
+    }
+    if (!assembly.used) {
+      target = &assembly;
+    } else if (!target || (target->used && isNewer(target->frameNumber, assembly.frameNumber))) {
+      target = &assembly;
+    }
+  }
+
+  target->used = true;
+  target->frameNumber = header.frameNumber;
+  target->stamp = header.stamp;
+  target->numMarkers = header.numMarkers;
+  target->fragmentCount = header.fragmentCount;
+  target->receivedFragments = 0;
+  // within the reserved capacity
+  target->markers.resize(3 * header.numMarkers);
+  return *target;
+}
+
+void UdpMarkerReceiver::resync()
+{
+  m_anyDelivered = false;
+  m_anyReceived = false;
+  m_consecutiveLate = 0;
+  for (Assembly& assembly : m_assemblies) {
+    assembly.used = false;
+  }
+  ++m_statistics.resyncs;
+}
+
+void UdpMarkerReceiver::deliver(Assembly& assembly, size_t& delivered, const FrameCallback& onFrame)
+{
+  if (m_anyDelivered) {
+    m_statistics.droppedFrames += assembly.frameNumber - m_lastDelivered - 1;
+  }
+  m_anyDelivered = true;
+  m_lastDelivered = assembly.frameNumber;
+  m_lastDeliveredStamp = assembly.stamp;
+  ++m_statistics.frames;
+  ++delivered;
+
+  std::chrono::high_resolution_clock::time_point stamp(
+    std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+      std::chrono::nanoseconds(assembly.stamp)));
+  onFrame(stamp, MarkerView(assembly.markers.data(), assembly.numMarkers));
+
+  // this frame and older incomplete ones are done
+  for (Assembly& other : m_assemblies) {
+    if (other.used && !isNewer(other.frameNumber, m_lastDelivered)) {
+      other.used = false;
+    }
+  }
+}
+
+} // namespace librigidbodytracker
@@ -0,0 +1,60 @@
+#pragma once
+#include <iostream>
+#include <stdexcept>
+
+// Minimal checks for the test executables, so the tests need nothing beyond
+// the library. A failed check is reported and makes main() fail.
+
+namespace librigidbodytracker {
+namespace test {
+
+  inline int& failures()
+  {
+    static int count = 0;
+    return count;
+  }
+
+  inline bool report(bool ok, const char* expression, const char* file, int line)
+  {
+    if (!ok) {
+      std::cerr << file << ":" << line << ": check failed: " << expression << std::endl;
+      ++failures();
+    }
+    return ok;
+  }
+
+  // runs a test case, counting exceptions escaping it as failures
+  template<class Fn>
+  void run(const char* name, Fn fn)
+  {
+    int const before = failures();
+    try {
+      fn();
+    } catch (const std::exception& e) {
+      std::cerr << name << ": unexpected exception: " << e.what() << std::endl;
+      ++failures();
+    }
+    std::cout << (failures() == before ? "[ok]     " : "[failed] ") << name << std::endl;
+  }
+
+} // namespace test
+} // namespace librigidbodytracker
+
+// evaluates to the outcome, e.g., to stop a loop after the first failure
+#define CHECK(expression) \
+  ::librigidbodytracker::test::report(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+
+#define CHECK_THROWS(statement) \
+  do { \
+    bool thrown = false; \
+    try { \
+      statement; \
+    } catch (const std::runtime_error&) { \
+      thrown = true; \
+    } \
+    CHECK(thrown && #statement); \
+  } while (0)
+
+#define RUN_TEST(fn) ::librigidbodytracker::test::run(#fn, fn)
+
+#define TEST_MAIN_RESULT() (::librigidbodytracker::test::failures() == 0 ? 0 : 1)
@@ -0,0 +1,250 @@
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "librigidbodytracker/marker_channel.h"
+#include "librigidbodytracker/rigid_body_tracker.h"
+#include "shared_memory.hpp"
+
+#include "check.hpp"
+
+using namespace librigidbodytracker;
+
+namespace {
+
+  std::string channelName(const std::string& test)
+  {
+    return "/lrbt_test_markers_" + test + "_" + std::to_string(getpid());
+  }
+
+  std::chrono::high_resolution_clock::time_point stampAt(int64_t ns)
+  {
+    return std::chrono::high_resolution_clock::time_point(
+      std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+        std::chrono::nanoseconds(ns)));
+  }
+
+  void roundTrip()
+  {
+    std::string const name = channelName("roundtrip");
+    MarkerChannelProducer producer(name, 4, 4);
+    MarkerChannelConsumer consumer(name);
+
+    std::chrono::high_resolution_clock::time_point stamp;
+    MarkerView markers(nullptr, 0);
+    CHECK(!consumer.peek(stamp, markers));
+
+    // strided input with ids, e.g., x, y, z, intensity
+    const float xyzi[] = {1, 2, 3, 0, 4, 5, 6, 0, 7, 8, 9, 0};
+    const uint32_t ids[] = {10, 11, 12};
+    CHECK(producer.push(stampAt(1000), MarkerView(xyzi, 3, 4 * sizeof(float), ids)));
+    const float xyz[] = {-1, -2, -3};
+    CHECK(producer.push(stampAt(2000), MarkerView(xyz, 1)));
+    CHECK(producer.pending() == 2);
+    CHECK(consumer.pending() == 2);
+
+    if (!CHECK(consumer.peek(stamp, markers)) || !CHECK(markers.count == 3)) {
+      return;
+    }
+    CHECK(stamp == stampAt(1000));
+    // read in place as packed triplets
+    CHECK(markers.stride == 3 * sizeof(float));
+    for (size_t i = 0; i < 3; ++i) {
+      CHECK(std::memcmp(markers.marker(i), xyzi + 4 * i, 3 * sizeof(float)) == 0);
+    }
+    CHECK(markers.ids && std::memcmp(markers.ids, ids, sizeof(ids)) == 0);
+    consumer.release();
+
+    if (!CHECK(consumer.peek(stamp, markers)) || !CHECK(markers.count == 1)) {
+      return;
+    }
+    CHECK(stamp == stampAt(2000));
+    CHECK(markers.marker(0)[2] == -3);
+    CHECK(markers.ids == nullptr);
+    consumer.release();
+
+    CHECK(!consumer.peek(stamp, markers));
+    CHECK(consumer.pending() == 0);
+    // nothing to release
+    consumer.release();
+    CHECK(consumer.pending() == 0);
+  }
+
+  void fullRingDropsFrames()
+  {
+    std::string const name = channelName("full");
+    MarkerChannelProducer producer(name, 1, 2);
+    MarkerChannelConsumer consumer(name);
+
+    const float xyz[] = {0, 0, 0};
+    CHECK(producer.push(stampAt(0), MarkerView(xyz, 1)));
+    CHECK(producer.push(stampAt(1), MarkerView(xyz, 1)));
+    CHECK(!producer.push(stampAt(2), MarkerView(xyz, 1)));
+    CHECK(producer.droppedCount() == 1);
+    CHECK(consumer.droppedCount() == 1);
+
+    // the frames waiting were not overwritten
+    std::chrono::high_resolution_clock::time_point stamp;
+    MarkerView markers(nullptr, 0);
+    CHECK(consumer.peek(stamp, markers) && stamp == stampAt(0));
+    consumer.release();
+    CHECK(producer.push(stampAt(3), MarkerView(xyz, 1)));
+    CHECK(consumer.peek(stamp, markers) && stamp == stampAt(1));
+    consumer.release();
+    CHECK(consumer.peek(stamp, markers) && stamp == stampAt(3));
+  }
+
+  void markersBeyondMaxAreIgnored()
+  {
+    std::string const name = channelName("max");
+    MarkerChannelProducer producer(name, 2, 2);
+    MarkerChannelConsumer consumer(name);
+
+    const float xyz[] = {1, 1, 1, 2, 2, 2, 3, 3, 3};
+    CHECK(producer.push(stampAt(0), MarkerView(xyz, 3)));
+    std::chrono::high_resolution_clock::time_point stamp;
+    MarkerView markers(nullptr, 0);
+    CHECK(consumer.peek(stamp, markers) && markers.count == 2 && markers.marker(1)[0] == 2);
+  }
+
+  void framesArriveInOrder()
+  {
+    std::string const name = channelName("order");
+    MarkerChannelProducer producer(name, 16, 4);
+    MarkerChannelConsumer consumer(name);
+
+    size_t const numFrames = 20000;
+    std::thread writer([&]() {
+      float xyz[3 * 16];
+      for (size_t f = 0; f < numFrames; ++f) {
+        std::fill(xyz, xyz + 3 * 16, float(f));
+        // the consumer is slower at times; retry instead of dropping
+        while (!producer.push(stampAt(f), MarkerView(xyz, 1 + f % 16))) {
+          std::this_thread::yield();
+        }
+      }
+    });
+
+    size_t next = 0;
+    bool ok = true;
+    while (next < numFrames && ok) {
+      std::chrono::high_resolution_clock::time_point stamp;
+      MarkerView markers(nullptr, 0);
+      if (!consumer.peek(stamp, markers)) {
+        std::this_thread::yield();
+        continue;
+      }
+      ok = CHECK(stamp == stampAt(next)) && CHECK(markers.count == 1 + next % 16);
+      for (size_t i = 0; ok && i < markers.count; ++i) {
+        ok = CHECK(markers.marker(i)[0] == float(next) && markers.marker(i)[2] == float(next));
+      }
+      consumer.release();
+      ++next;
+    }
+    writer.join();
+    CHECK(next == numFrames);
+  }
+
+  void trackerReadsChannel()
+  {
+    DynamicsConfiguration dynamics;
+    dynamics.maxXVelocity = dynamics.maxYVelocity = dynamics.maxZVelocity = 2;
+    dynamics.maxRollRate = dynamics.maxPitchRate = dynamics.maxYawRate = 10;
+    dynamics.maxRoll = dynamics.maxPitch = 1;
+    dynamics.maxFitnessScore = 0.001;
+    MarkerConfiguration configuration(new PointCloud);
+    configuration->push_back(PointXYZ(0, 0, 0.02));
+    configuration->push_back(PointXYZ(0.03, 0, 0));
+    configuration->push_back(PointXYZ(0, 0.05, 0));
+    configuration->push_back(PointXYZ(-0.04, -0.02, 0));
+    std::vector<RigidBody> rigidBodies;
+    rigidBodies.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(0, 0, 0)), "cf0");
+    rigidBodies.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(1, 0, 0)), "cf1");
+    RigidBodyTracker tracker({dynamics}, {configuration}, rigidBodies);
+
+    std::string const name = channelName("tracker");
+    MarkerChannelProducer producer(name, 16, 8);
+    MarkerChannelConsumer consumer(name);
+    CHECK(!tracker.updateFromChannel(consumer));
+
+    std::vector<float> xyz;
+    std::vector<Eigen::Vector3f> centers(2);
+    for (int f = 0; f < 50; ++f) {
+      xyz.clear();
+      for (size_t b = 0; b < 2; ++b) {
+        Eigen::Affine3f pose = Eigen::Translation3f(b + 0.005f * f, 0.002f * f, 0)
+          * Eigen::AngleAxisf(0.01f * f, Eigen::Vector3f::UnitZ());
+        centers[b] = pose.translation();
+        for (const PointXYZ& p : *configuration) {
+          Eigen::Vector3f v = pose * Eigen::Vector3f(p.x, p.y, p.z);
+          xyz.insert(xyz.end(), {v.x(), v.y(), v.z()});
+        }
+      }
+      CHECK(producer.push(stampAt(int64_t(f) * 10000000), MarkerView(xyz.data(), xyz.size() / 3)));
+      CHECK(tracker.updateFromChannel(consumer));
+    }
+    CHECK(consumer.pending() == 0);
+
+    for (size_t b = 0; b < 2; ++b) {
+      const RigidBody& rigidBody = tracker.rigidBodies()[b];
+      CHECK(rigidBody.lastTransformationValid());
+      CHECK((rigidBody.center() - centers[b]).norm() < 1e-4);
+    }
+
+    // with newestOnly, frames waiting behind the newest one are skipped
+    for (int f = 50; f < 53; ++f) {
+      producer.push(stampAt(int64_t(f) * 10000000), MarkerView(xyz.data(), xyz.size() / 3));
+    }
+    CHECK(tracker.updateFromChannel(consumer, true));
+    CHECK(consumer.pending() == 0);
+    CHECK(tracker.ingestStatistics().skippedFrames == 2);
+  }
+
+  void rejectsOtherSegments()
+  {
+    CHECK_THROWS(MarkerChannelConsumer consumer(channelName("missing")));
+
+    std::string const name = channelName("malformed");
+    SharedMemory memory(name, sizeof(MarkerChannelHeader));
+    CHECK_THROWS(MarkerChannelConsumer consumer(name));
+
+    // a valid header announcing more slots than the segment holds
+    MarkerChannelHeader* header = static_cast<MarkerChannelHeader*>(memory.data());
+    std::memcpy(header->magic, "LRBTMRK", sizeof(header->magic));
+    header->version = MarkerChannelVersion;
+    header->numSlots = 2;
+    header->maxMarkers = 1;
+    header->slotSize = 128;
+    try {
+      MarkerChannelConsumer consumer(name);
+      CHECK(!"truncated segment accepted");
+    } catch (const std::runtime_error& e) {
+      CHECK(std::string(e.what()).find("truncated") != std::string::npos);
+    }
+
+    // slots too small for maxMarkers
+    header->numSlots = 0;
+    CHECK_THROWS(MarkerChannelConsumer consumer(name));
+    header->numSlots = 2;
+    header->maxMarkers = 100;
+    CHECK_THROWS(MarkerChannelConsumer consumer(name));
+
+    header->version = MarkerChannelVersion + 1;
+    CHECK_THROWS(MarkerChannelConsumer consumer(name));
+  }
+
+} // anonymous namespace
+
+int main()
+{
+  RUN_TEST(roundTrip);
+  RUN_TEST(fullRingDropsFrames);
+  RUN_TEST(markersBeyondMaxAreIgnored);
+  RUN_TEST(framesArriveInOrder);
+  RUN_TEST(trackerReadsChannel);
+  RUN_TEST(rejectsOtherSegments);
+  return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,191 @@
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include "librigidbodytracker/pose_channel.h"
+#include "librigidbodytracker/rigid_body_tracker.h"
+#include "shared_memory.hpp"
+
+#include "check.hpp"
+
+using namespace librigidbodytracker;
+
+namespace {
+
+  std::string channelName(const std::string& test)
+  {
+    return "/lrbt_test_pose_" + test + "_" + std::to_string(getpid());
+  }
+
+  std::chrono::high_resolution_clock::time_point stampAt(int64_t ns)
+  {
+    return std::chrono::high_resolution_clock::time_point(
+      std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+        std::chrono::nanoseconds(ns)));
+  }
+
+  RigidBody bodyAt(const std::string& name, float x, float y, float z)
+  {
+    return RigidBody(0, 0, Eigen::Affine3f(Eigen::Translation3f(x, y, z)), name);
+  }
+
+  void roundTrip()
+  {
+    std::string const name = channelName("roundtrip");
+    PosePublisher publisher(name, 2, 4);
+    PoseSubscriber subscriber(name);
+
+    PublishedFrame frame;
+    CHECK(subscriber.frameCount() == 0);
+    CHECK(!subscriber.readLatest(frame));
+
+    std::vector<RigidBody> rigidBodies;
+    rigidBodies.push_back(bodyAt("cf1", 1, 2, 3));
+    rigidBodies.push_back(bodyAt("a_name_longer_than_the_published_field", 4, 5, 6));
+    // beyond maxRigidBodies, not published
+    rigidBodies.push_back(bodyAt("cf3", 7, 8, 9));
+    publisher.publish(stampAt(5000000), rigidBodies);
+
+    CHECK(publisher.frameCount() == 1);
+    CHECK(subscriber.frameCount() == 1);
+    if (!CHECK(subscriber.readLatest(frame)) || !CHECK(frame.poses.size() == 2)) {
+      return;
+    }
+    CHECK(frame.frame == 0);
+    CHECK(frame.stamp == stampAt(5000000));
+
+    const PublishedPose& first = frame.poses[0];
+    CHECK(std::string(first.name) == "cf1");
+    CHECK(first.position[0] == 1 && first.position[1] == 2 && first.position[2] == 3);
+    // identity without orientation
+    CHECK(first.orientation[0] == 0 && first.orientation[1] == 0
+      && first.orientation[2] == 0 && first.orientation[3] == 1);
+    CHECK(!first.hasOrientation);
+    CHECK(!first.valid);
+
+    const PublishedPose& second = frame.poses[1];
+    CHECK(std::string(second.name) == rigidBodies[1].name().substr(0, sizeof(second.name) - 1));
+    CHECK(second.position[2] == 6);
+  }
+
+  void overwrittenAndFutureFramesAreNotRead()
+  {
+    std::string const name = channelName("ring");
+    PosePublisher publisher(name, 1, 2);
+    PoseSubscriber subscriber(name);
+
+    std::vector<RigidBody> rigidBodies(1, bodyAt("cf1", 0, 0, 0));
+    for (int64_t i = 0; i < 3; ++i) {
+      publisher.publish(stampAt(i), rigidBodies);
+    }
+
+    PublishedFrame frame;
+    // frame 0 shared its slot with frame 2
+    CHECK(!subscriber.read(0, frame));
+    CHECK(subscriber.read(1, frame) && frame.frame == 1);
+    CHECK(subscriber.read(2, frame) && frame.stamp == stampAt(2));
+    CHECK(!subscriber.read(3, frame));
+  }
+
+  void slotBeingWrittenIsNotRead()
+  {
+    std::string const name = channelName("seqlock");
+    PosePublisher publisher(name, 1, 2);
+    PoseSubscriber subscriber(name);
+    std::vector<RigidBody> rigidBodies(1, bodyAt("cf1", 0, 0, 0));
+    publisher.publish(stampAt(0), rigidBodies);
+
+    // pretend the publisher is in the middle of rewriting frame 0's slot
+    SharedMemory memory(name, true);
+    PoseSlotHeader* slot = reinterpret_cast<PoseSlotHeader*>(
+      static_cast<uint8_t*>(memory.data()) + sizeof(PoseChannelHeader));
+    slot->seq.store(1);
+
+    PublishedFrame frame;
+    CHECK(!subscriber.read(0, frame));
+    CHECK(!subscriber.readLatest(frame));
+
+    slot->seq.store(2);
+    CHECK(subscriber.readLatest(frame));
+  }
+
+  void concurrentReadsAreConsistent()
+  {
+    std::string const name = channelName("concurrent");
+    // two slots, so the publisher overwrites slots while they are read
+    PosePublisher publisher(name, 4, 2);
+    PoseSubscriber subscriber(name);
+
+    size_t const numFrames = 20000;
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+      std::vector<RigidBody> rigidBodies;
+      for (size_t f = 0; f < numFrames; ++f) {
+        rigidBodies.assign(4, bodyAt("cf", f, f, f));
+        publisher.publish(stampAt(f), rigidBodies);
+      }
+      done = true;
+    });
+
+    size_t reads = 0;
+    bool consistent = true;
+    PublishedFrame frame;
+    while (!done && consistent) {
+      if (!subscriber.readLatest(frame)) {
+        continue;
+      }
+      ++reads;
+      // a torn copy would mix poses of different frames
+      float const expected = frame.frame;
+      consistent = CHECK(frame.stamp == stampAt(frame.frame))
+        && CHECK(frame.poses.size() == 4);
+      for (size_t i = 0; consistent && i < frame.poses.size(); ++i) {
+        consistent = CHECK(frame.poses[i].position[0] == expected)
+          && CHECK(frame.poses[i].position[2] == expected);
+      }
+    }
+    writer.join();
+
+    CHECK(reads > 0);
+    CHECK(subscriber.readLatest(frame) && frame.frame == numFrames - 1);
+  }
+
+  void rejectsOtherSegments()
+  {
+    CHECK_THROWS(PoseSubscriber subscriber(channelName("missing")));
+
+    std::string const name = channelName("malformed");
+    SharedMemory memory(name, sizeof(PoseChannelHeader));
+    CHECK_THROWS(PoseSubscriber subscriber(name));
+
+    // a valid header announcing more slots than the segment holds
+    PoseChannelHeader* header = static_cast<PoseChannelHeader*>(memory.data());
+    std::memcpy(header->magic, "LRBTPOS", sizeof(header->magic));
+    header->version = PoseChannelVersion;
+    header->numSlots = 2;
+    header->maxRigidBodies = 1;
+    header->slotSize = sizeof(PoseSlotHeader) + sizeof(PublishedPose);
+    try {
+      PoseSubscriber subscriber(name);
+      CHECK(!"truncated segment accepted");
+    } catch (const std::runtime_error& e) {
+      CHECK(std::string(e.what()).find("truncated") != std::string::npos);
+    }
+
+    header->version = PoseChannelVersion + 1;
+    CHECK_THROWS(PoseSubscriber subscriber(name));
+  }
+
+} // anonymous namespace
+
+int main()
+{
+  RUN_TEST(roundTrip);
+  RUN_TEST(overwrittenAndFutureFramesAreNotRead);
+  RUN_TEST(slotBeingWrittenIsNotRead);
+  RUN_TEST(concurrentReadsAreConsistent);
+  RUN_TEST(rejectsOtherSegments);
+  return TEST_MAIN_RESULT();
+}
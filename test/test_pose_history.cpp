@@ -0,0 +1,170 @@
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "librigidbodytracker/pose_history.h"
+
+#include "check.hpp"
+
+using namespace librigidbodytracker;
+
+namespace {
+
+  std::chrono::high_resolution_clock::time_point stampAt(double seconds)
+  {
+    return std::chrono::high_resolution_clock::time_point(
+      std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+        std::chrono::duration<double>(seconds)));
+  }
+
+  // moving along x at 1 m/s (and along -y, as a second copy of the same
+  // value), turning about z at 1 rad/s
+  PoseEstimate stateAt(double seconds, bool hasOrientation = true)
+  {
+    PoseEstimate state;
+    state.stamp = stampAt(seconds);
+    state.position = Eigen::Vector3f(seconds, -seconds, 0);
+    state.orientation = hasOrientation
+      ? Eigen::Quaternionf(Eigen::AngleAxisf(seconds, Eigen::Vector3f::UnitZ()))
+      : Eigen::Quaternionf::Identity();
+    state.velocity = Eigen::Vector3f(1, -1, 0);
+    state.hasOrientation = hasOrientation;
+    return state;
+  }
+
+  bool near(const PoseEstimate& state, double seconds, float tolerance)
+  {
+    PoseEstimate const expected = stateAt(seconds, state.hasOrientation);
+    return CHECK(state.stamp == expected.stamp)
+      && CHECK((state.position - expected.position).norm() < tolerance)
+      && CHECK((state.velocity - expected.velocity).norm() < tolerance)
+      && CHECK(state.orientation.angularDistance(expected.orientation) < tolerance);
+  }
+
+  void interpolatesBetweenStates()
+  {
+    PoseHistory history(8, 0.05);
+    PoseEstimate state;
+    CHECK(!history.latest(state));
+    CHECK(!history.at(stampAt(0), state));
+
+    for (int i = 0; i < 5; ++i) {
+      history.push(stateAt(0.1 * i));
+    }
+    CHECK(history.latest(state) && near(state, 0.1 * 4, 1e-6));
+    // exact stamps, and between them (slerp for the orientation)
+    CHECK(history.at(stampAt(0.1 * 2), state) && near(state, 0.1 * 2, 1e-6));
+    CHECK(history.at(stampAt(0.25), state) && near(state, 0.25, 1e-5));
+    CHECK(history.at(stampAt(0.01), state) && near(state, 0.01, 1e-5));
+    CHECK(history.at(stampAt(0), state) && near(state, 0, 1e-6));
+
+    // one end without orientation: none in between either
+    PoseHistory positionOnly(8, 0.05);
+    positionOnly.push(stateAt(0));
+    positionOnly.push(stateAt(0.1, false));
+    CHECK(positionOnly.at(stampAt(0.05), state));
+    CHECK(!state.hasOrientation);
+    CHECK(state.orientation.isApprox(Eigen::Quaternionf::Identity()));
+    CHECK(std::fabs(state.position.x() - 0.05f) < 1e-6);
+  }
+
+  void extrapolatesUpToMaxExtrapolation()
+  {
+    PoseHistory history(8, 0.05);
+    for (int i = 0; i < 3; ++i) {
+      history.push(stateAt(0.1 * i));
+    }
+    PoseEstimate state;
+    // constant velocity and orientation beyond the newest state
+    CHECK(history.at(stampAt(0.23), state));
+    CHECK(state.stamp == stampAt(0.23));
+    CHECK((state.position - Eigen::Vector3f(0.23, -0.23, 0)).norm() < 1e-6);
+    CHECK(state.orientation.angularDistance(stateAt(0.2).orientation) < 1e-6);
+    CHECK(history.at(stampAt(0.249), state));
+    CHECK(!history.at(stampAt(0.251), state));
+    CHECK(!history.at(stampAt(1), state));
+
+    PoseHistory noExtrapolation(8, 0);
+    noExtrapolation.push(stateAt(0));
+    CHECK(noExtrapolation.at(stampAt(0), state));
+    CHECK(!noExtrapolation.at(stampAt(0.001), state));
+  }
+
+  void rejectsStampsOlderThanTheHistory()
+  {
+    PoseHistory history(4, 0.05);
+    PoseEstimate state;
+    history.push(stateAt(1));
+    CHECK(!history.at(stampAt(0.9), state));
+
+    // only the last four of ten states (1.6 ... 1.9 s) are kept
+    for (int i = 1; i < 10; ++i) {
+      history.push(stateAt(1 + 0.1 * i));
+    }
+    CHECK(history.at(stampAt(1 + 0.1 * 6), state) && near(state, 1 + 0.1 * 6, 1e-5));
+    CHECK(history.at(stampAt(1.65), state) && near(state, 1.65, 1e-5));
+    CHECK(!history.at(stampAt(1.59), state));
+    CHECK(!history.at(stampAt(1.0), state));
+  }
+
+  void readsWhileTheWriterWrapsAround()
+  {
+    // a small ring wraps around every few states, so readers regularly
+    // find the slots they read overwritten
+    PoseHistory history(4, 0.05);
+    int const numStates = 100000;
+    double const dt = 0.001;
+    history.push(stateAt(0));
+
+    std::atomic<bool> done(false);
+    std::atomic<int> torn(0);
+    std::atomic<int> answered(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; ++r) {
+      readers.emplace_back([&, r]() {
+        PoseEstimate state;
+        while (!done.load()) {
+          if (!history.latest(state)) {
+            ++torn;
+            continue;
+          }
+          double const newest = std::chrono::duration<double>(state.stamp.time_since_epoch()).count();
+          // behind the newest state (possibly overwritten by now), or ahead
+          double const seconds = newest + (r - 1) * 1.5 * dt;
+          if (!history.at(stampAt(seconds), state)) {
+            continue;
+          }
+          ++answered;
+          // a mix of two states would break the relation between the values
+          float const x = seconds;
+          if (std::fabs(state.position.x() - x) > 1e-3
+              || std::fabs(state.position.y() + x) > 1e-3
+              || (state.velocity - Eigen::Vector3f(1, -1, 0)).norm() > 1e-5) {
+            ++torn;
+          }
+        }
+      });
+    }
+
+    for (int i = 1; i < numStates; ++i) {
+      history.push(stateAt(i * dt));
+    }
+    done = true;
+    for (std::thread& reader : readers) {
+      reader.join();
+    }
+    CHECK(torn == 0);
+    CHECK(answered > 0);
+  }
+
+} // anonymous namespace
+
+int main()
+{
+  RUN_TEST(interpolatesBetweenStates);
+  RUN_TEST(extrapolatesUpToMaxExtrapolation);
+  RUN_TEST(rejectsStampsOlderThanTheHistory);
+  RUN_TEST(readsWhileTheWriterWrapsAround);
+  return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,214 @@
+#include <string>
+#include <vector>
+
+#include "librigidbodytracker/rigid_body_tracker.h"
+
+#include "check.hpp"
+
+using namespace librigidbodytracker;
+
+namespace {
+
+  DynamicsConfiguration dynamics()
+  {
+    DynamicsConfiguration dynConf;
+    dynConf.maxXVelocity = dynConf.maxYVelocity = dynConf.maxZVelocity = 2;
+    dynConf.maxRollRate = dynConf.maxPitchRate = dynConf.maxYawRate = 10;
+    dynConf.maxRoll = dynConf.maxPitch = 1;
+    dynConf.maxFitnessScore = 0.001;
+    return dynConf;
+  }
+
+  MarkerConfiguration fourMarkers()
+  {
+    MarkerConfiguration configuration(new MarkerCloud);
+    configuration->push_back(MarkerCloud::PointType(0, 0, 0.02));
+    configuration->push_back(MarkerCloud::PointType(0.03, 0, 0));
+    configuration->push_back(MarkerCloud::PointType(0, 0.05, 0));
+    configuration->push_back(MarkerCloud::PointType(-0.04, -0.02, 0));
+    return configuration;
+  }
+
+  // appends the markers of configuration at pose to cloud
+  void addMarkers(const MarkerConfiguration& configuration, const Eigen::Affine3f& pose,
+    PointCloud& cloud)
+  {
+    for (const auto& p : *configuration) {
+      Eigen::Vector3f v = pose * Eigen::Vector3f(p.x, p.y, p.z);
+      cloud.push_back(PointXYZ(v.x(), v.y(), v.z()));
+    }
+  }
+
+  std::chrono::high_resolution_clock::time_point stampAt(double seconds)
+  {
+    return std::chrono::high_resolution_clock::time_point(
+      std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+        std::chrono::duration<double>(seconds)));
+  }
+
+  void overlappingBodiesDoNotShareMarkers()
+  {
+    // b is close enough to a that a's markers are within its reach
+    MarkerConfiguration configuration = fourMarkers();
+    std::vector<RigidBody> rigidBodies;
+    rigidBodies.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(0, 0, 0)), "a");
+    rigidBodies.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(0.06, 0, 0)), "b");
+    RigidBodyTracker tracker({dynamics()}, {configuration}, rigidBodies);
+
+    for (int f = 0; f < 20; ++f) {
+      PointCloud::Ptr markers(new PointCloud);
+      addMarkers(configuration, Eigen::Affine3f(Eigen::Translation3f(0, 0, 0)), *markers);
+      // b is occluded after a few frames
+      if (f < 5) {
+        addMarkers(configuration, Eigen::Affine3f(Eigen::Translation3f(0.06, 0, 0)), *markers);
+      }
+      tracker.update(stampAt(0.1 * f), markers);
+
+      const RigidBody& a = tracker.rigidBodies()[0];
+      const RigidBody& b = tracker.rigidBodies()[1];
+      if (!CHECK(a.lastTransformationValid()) || !CHECK(a.center().norm() < 1e-4)) {
+        break;
+      }
+      // both valid on the same markers would put them on top of each other
+      if (b.lastTransformationValid()
+          && !CHECK((b.center() - Eigen::Vector3f(0.06, 0, 0)).norm() < 1e-4)) {
+        break;
+      }
+      if (f < 5) {
+        CHECK(b.lastTransformationValid());
+      }
+    }
+  }
+
+  MarkerConfiguration oneMarker()
+  {
+    MarkerConfiguration configuration(new MarkerCloud);
+    configuration->push_back(MarkerCloud::PointType(0, 0, 0));
+    return configuration;
+  }
+
+  PointCloud::Ptr cloudOf(const std::vector<Eigen::Vector3f>& points)
+  {
+    PointCloud::Ptr cloud(new PointCloud);
+    for (const Eigen::Vector3f& p : points) {
+      cloud->push_back(PointXYZ(p.x(), p.y(), p.z()));
+    }
+    return cloud;
+  }
+
+  void singleMarkerBodiesIgnoreMarkersOutOfReach()
+  {
+    // 1 m apart, so markers farther than 1/3 m are out of reach
+    std::vector<RigidBody> rigidBodies;
+    rigidBodies.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(0, 0, 0)), "a");
+    rigidBodies.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(1, 0, 0)), "b");
+    RigidBodyTracker tracker({dynamics()}, {oneMarker()}, rigidBodies);
+    const RigidBody& a = tracker.rigidBodies()[0];
+    const RigidBody& b = tracker.rigidBodies()[1];
+
+    Eigen::Vector3f const stray(3, 3, 0);
+    int f = 0;
+    for (; f < 10; ++f) {
+      tracker.update(stampAt(0.01 * f), cloudOf({Eigen::Vector3f(0, 0, 0), stray}));
+      CHECK(a.lastTransformationValid() && a.center().norm() < 1e-6);
+      CHECK(!b.lastTransformationValid());
+    }
+
+    Eigen::Vector3f const bMarker(1.05, 0, 0);
+    tracker.update(stampAt(0.01 * f++), cloudOf({Eigen::Vector3f(0, 0, 0), stray, bMarker}));
+    // b may wait for its re-initialization backoff
+    for (int i = 0; i < 40 && !b.lastTransformationValid(); ++i) {
+      tracker.update(stampAt(0.01 * f++), cloudOf({Eigen::Vector3f(0, 0, 0), stray, bMarker}));
+    }
+    CHECK(b.lastTransformationValid() && (b.center() - bMarker).norm() < 1e-6);
+
+    // once lost, b is not re-acquired on a marker far from where it was
+    for (int i = 0; i < 60; ++i) {
+      tracker.update(stampAt(0.01 * f++), cloudOf({Eigen::Vector3f(0, 0, 0), stray}));
+    }
+    CHECK(!b.lastTransformationValid());
+    CHECK((b.center() - bMarker).norm() < 1e-6);
+  }
+
+  void acquiringBodyLeavesTrackedMarkersAlone()
+  {
+    // a single-marker and a multi-marker body still acquiring next to a
+    // tracked body that moves into their reach
+    MarkerConfiguration configuration = fourMarkers();
+    std::vector<RigidBody> rigidBodies;
+    rigidBodies.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(0, 0, 0)), "tracked");
+    rigidBodies.emplace_back(1, 0, Eigen::Affine3f(Eigen::Translation3f(0.3, 0, 0)), "single");
+    rigidBodies.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(-0.3, 0, 0)), "multi");
+    RigidBodyTracker tracker({dynamics()}, {configuration, oneMarker()}, rigidBodies);
+    const RigidBody& tracked = tracker.rigidBodies()[0];
+    const RigidBody& single = tracker.rigidBodies()[1];
+    const RigidBody& multi = tracker.rigidBodies()[2];
+
+    // at 1 m/s to the single-marker body and back, then to the multi-marker
+    // body and back
+    const float legStart[] = {0, 0.25f, 0, -0.25f};
+    const float legDirection[] = {1, -1, -1, 1};
+    for (int f = 0; f < 100; ++f) {
+      float const x = legStart[f / 25] + legDirection[f / 25] * 0.01f * (f % 25);
+      Eigen::Affine3f const pose(Eigen::Translation3f(x, 0, 0));
+      PointCloud::Ptr markers(new PointCloud);
+      addMarkers(configuration, pose, *markers);
+      tracker.update(stampAt(0.01 * f), markers);
+
+      bool const ok = CHECK(tracked.lastTransformationValid())
+        && CHECK((tracked.center() - pose.translation()).norm() < 1e-4)
+        && CHECK(!single.lastTransformationValid())
+        && CHECK(!multi.lastTransformationValid());
+      if (!ok) {
+        break;
+      }
+    }
+  }
+
+  void positionOnlyBodyChecksMarkerSpread()
+  {
+    MarkerConfiguration configuration = fourMarkers();
+    std::vector<RigidBody> rigidBodies;
+    rigidBodies.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(0, 0, 0)), "a");
+    rigidBodies.back().setPositionOnly(true);
+    RigidBodyTracker tracker({dynamics()}, {configuration}, rigidBodies);
+    const RigidBody& a = tracker.rigidBodies()[0];
+
+    int f = 0;
+    for (; f < 30; ++f) {
+      Eigen::Affine3f const pose(Eigen::Translation3f(0.01f * f, 0, 0));
+      PointCloud::Ptr markers(new PointCloud);
+      addMarkers(configuration, pose, *markers);
+      tracker.update(stampAt(0.01 * f), markers);
+
+      bool const ok = CHECK(a.lastTransformationValid())
+        && CHECK((a.center() - pose.translation()).norm() < 1e-4);
+      if (!ok) {
+        return;
+      }
+    }
+    CHECK(a.trackingMode() == CentroidMode);
+
+    // a configuration scaled by 1.3 has 1.69 times the spread (about 1e-3 m^2
+    // more), which does not belong to the body
+    for (; f < 40; ++f) {
+      Eigen::Affine3f const pose(Eigen::Translation3f(0.01f * f, 0, 0));
+      PointCloud::Ptr markers(new PointCloud);
+      addMarkers(configuration, pose * Eigen::Scaling(1.3f), *markers);
+      tracker.update(stampAt(0.01 * f), markers);
+      if (!CHECK(!a.lastTransformationValid())) {
+        return;
+      }
+    }
+  }
+
+} // anonymous namespace
+
+int main()
+{
+  RUN_TEST(overlappingBodiesDoNotShareMarkers);
+  RUN_TEST(singleMarkerBodiesIgnoreMarkersOutOfReach);
+  RUN_TEST(acquiringBodyLeavesTrackedMarkersAlone);
+  RUN_TEST(positionOnlyBodyChecksMarkerSpread);
+  return TEST_MAIN_RESULT();
+}
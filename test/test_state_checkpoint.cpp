@@ -0,0 +1,182 @@
+#include <string>
+#include <vector>
+
+#include "librigidbodytracker/rigid_body_tracker.h"
+
+#include "check.hpp"
+
+using namespace librigidbodytracker;
+
+namespace {
+
+  DynamicsConfiguration dynamics()
+  {
+    DynamicsConfiguration dynConf;
+    dynConf.maxXVelocity = dynConf.maxYVelocity = dynConf.maxZVelocity = 2;
+    dynConf.maxRollRate = dynConf.maxPitchRate = dynConf.maxYawRate = 10;
+    dynConf.maxRoll = dynConf.maxPitch = 1;
+    dynConf.maxFitnessScore = 0.001;
+    dynConf.useMotionFilter = true;
+    return dynConf;
+  }
+
+  MarkerConfiguration fourMarkers()
+  {
+    MarkerConfiguration configuration(new MarkerCloud);
+    configuration->push_back(MarkerCloud::PointType(0, 0, 0.02));
+    configuration->push_back(MarkerCloud::PointType(0.03, 0, 0));
+    configuration->push_back(MarkerCloud::PointType(0, 0.05, 0));
+    configuration->push_back(MarkerCloud::PointType(-0.04, -0.02, 0));
+    return configuration;
+  }
+
+  MarkerConfiguration oneMarker()
+  {
+    MarkerConfiguration configuration(new MarkerCloud);
+    configuration->push_back(MarkerCloud::PointType(0, 0, 0));
+    return configuration;
+  }
+
+  std::vector<RigidBody> rigidBodies()
+  {
+    std::vector<RigidBody> result;
+    result.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(0, 0, 0)), "pose");
+    result.emplace_back(0, 0, Eigen::Affine3f(Eigen::Translation3f(1, 0, 0)), "position");
+    result.emplace_back(1, 0, Eigen::Affine3f(Eigen::Translation3f(0, 1, 0)), "single");
+    return result;
+  }
+
+  std::chrono::high_resolution_clock::time_point stampAt(double seconds)
+  {
+    return std::chrono::high_resolution_clock::time_point(
+      std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+        std::chrono::duration<double>(seconds)));
+  }
+
+  // all three bodies of rigidBodies() moving at 0.5 m/s, in frame f
+  PointCloud::Ptr markersAt(int f)
+  {
+    MarkerConfiguration const configuration = fourMarkers();
+    PointCloud::Ptr cloud(new PointCloud);
+    float const d = 0.005f * f;
+    const Eigen::Affine3f poses[] = {
+      Eigen::Affine3f(Eigen::Translation3f(d, 0, 0)),
+      Eigen::Affine3f(Eigen::Translation3f(1, d, 0)),
+    };
+    for (const Eigen::Affine3f& pose : poses) {
+      for (const auto& p : *configuration) {
+        Eigen::Vector3f v = pose * Eigen::Vector3f(p.x, p.y, p.z);
+        cloud->push_back(PointXYZ(v.x(), v.y(), v.z()));
+      }
+    }
+    cloud->push_back(PointXYZ(d, 1, 0));
+    return cloud;
+  }
+
+  bool sameState(const RigidBody& a, const RigidBody& b)
+  {
+    const MotionFilter& fa = a.motionFilter();
+    const MotionFilter& fb = b.motionFilter();
+    return CHECK(a.name() == b.name())
+      && CHECK(a.transformation().matrix() == b.transformation().matrix())
+      && CHECK(a.lastTransformationValid() == b.lastTransformationValid())
+      && CHECK(a.lastValidTime() == b.lastValidTime())
+      && CHECK(a.initialized() == b.initialized())
+      && CHECK(a.trackingMode() == b.trackingMode())
+      && CHECK(fa.initialized() == fb.initialized())
+      && CHECK(fa.stamp() == fb.stamp())
+      && CHECK(fa.position() == fb.position())
+      && CHECK(fa.velocity() == fb.velocity())
+      && CHECK(fa.positionVariance() == fb.positionVariance())
+      && CHECK(fa.velocityVariance() == fb.velocityVariance());
+  }
+
+  void roundTripRestoresTrackingState()
+  {
+    RigidBodyTracker original({dynamics()}, {fourMarkers(), oneMarker()}, rigidBodies());
+    // switched at runtime, so only the checkpoint knows about it
+    original.setPositionOnly(1, true);
+    int f = 0;
+    for (; f < 20; ++f) {
+      original.update(stampAt(0.01 * f), markersAt(f));
+    }
+    for (const RigidBody& rigidBody : original.rigidBodies()) {
+      CHECK(rigidBody.lastTransformationValid());
+      CHECK(rigidBody.motionFilter().initialized());
+    }
+    CHECK(original.rigidBodies()[1].trackingMode() == CentroidMode);
+
+    RigidBodyTracker restarted({dynamics()}, {fourMarkers(), oneMarker()}, rigidBodies());
+    if (!CHECK(restarted.restoreState(original.saveState()) == 3)) {
+      return;
+    }
+    for (size_t i = 0; i < 3; ++i) {
+      if (!sameState(original.rigidBodies()[i], restarted.rigidBodies()[i])) {
+        return;
+      }
+    }
+
+    // both continue alike, so the velocities were restored as well
+    for (; f < 25; ++f) {
+      original.update(stampAt(0.01 * f), markersAt(f));
+      restarted.update(stampAt(0.01 * f), markersAt(f));
+      for (size_t i = 0; i < 3; ++i) {
+        if (!sameState(original.rigidBodies()[i], restarted.rigidBodies()[i])) {
+          return;
+        }
+      }
+    }
+  }
+
+  void otherMarkerConfigurationIsRejected()
+  {
+    RigidBodyTracker original({dynamics()}, {fourMarkers(), oneMarker()}, rigidBodies());
+    for (int f = 0; f < 5; ++f) {
+      original.update(stampAt(0.01 * f), markersAt(f));
+    }
+    std::vector<uint8_t> const state = original.saveState();
+
+    // same names, but the first marker moved
+    MarkerConfiguration edited = fourMarkers();
+    (*edited)[0].z = 0.03;
+    RigidBodyTracker restarted({dynamics()}, {edited, oneMarker()}, rigidBodies());
+    CHECK_THROWS(restarted.restoreState(state));
+    // nothing was restored
+    for (const RigidBody& rigidBody : restarted.rigidBodies()) {
+      CHECK(!rigidBody.initialized());
+      CHECK(!rigidBody.motionFilter().initialized());
+    }
+
+    // a body with another number of markers
+    RigidBodyTracker swapped({dynamics()}, {oneMarker(), fourMarkers()}, rigidBodies());
+    CHECK_THROWS(swapped.restoreState(state));
+
+    // bodies that are not in the configuration anymore are ignored
+    std::vector<RigidBody> remaining = rigidBodies();
+    remaining.erase(remaining.begin());
+    RigidBodyTracker fewer({dynamics()}, {fourMarkers(), oneMarker()}, remaining);
+    CHECK(fewer.restoreState(state) == 2);
+  }
+
+  void corruptStateIsRejected()
+  {
+    RigidBodyTracker tracker({dynamics()}, {fourMarkers(), oneMarker()}, rigidBodies());
+    std::vector<uint8_t> state = tracker.saveState();
+    std::vector<uint8_t> truncated(state.begin(), state.end() - 1);
+    CHECK_THROWS(tracker.restoreState(truncated));
+    std::vector<uint8_t> trailing = state;
+    trailing.push_back(0);
+    CHECK_THROWS(tracker.restoreState(trailing));
+    state[0] = 'X';
+    CHECK_THROWS(tracker.restoreState(state));
+  }
+
+} // anonymous namespace
+
+int main()
+{
+  RUN_TEST(roundTripRestoresTrackingState);
+  RUN_TEST(otherMarkerConfigurationIsRejected);
+  RUN_TEST(corruptStateIsRejected);
+  return TEST_MAIN_RESULT();
+}
@@ -0,0 +1,338 @@
+#include <arpa/inet.h>
+#include <cstring>
+#include <netinet/in.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "librigidbodytracker/udp_marker_stream.h"
+
+#include "check.hpp"
+
+using namespace librigidbodytracker;
+
+namespace {
+
+  // one port per test case, derived from the pid so that concurrent runs do
+  // not collide
+  uint16_t testPort(int offset)
+  {
+    return 20000 + (getpid() % 4000) * 10 + offset;
+  }
+
+  std::chrono::high_resolution_clock::time_point stampAt(int64_t ns)
+  {
+    return std::chrono::high_resolution_clock::time_point(
+      std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+        std::chrono::nanoseconds(ns)));
+  }
+
+  struct ReceivedFrame
+  {
+    int64_t stamp;
+    std::vector<float> markers;
+  };
+
+  // receives all datagrams sent so far
+  std::vector<ReceivedFrame> receiveAll(UdpMarkerReceiver& receiver)
+  {
+    std::vector<ReceivedFrame> frames;
+    receiver.receive(std::chrono::milliseconds(100), [&frames](
+      std::chrono::high_resolution_clock::time_point stamp, const MarkerView& markers) {
+      ReceivedFrame frame;
+      frame.stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        stamp.time_since_epoch()).count();
+      frame.markers.assign(markers.data, markers.data + 3 * markers.count);
+      frames.push_back(frame);
+    });
+    return frames;
+  }
+
+  // sends handcrafted datagrams to the receiver on localhost
+  class RawSender
+  {
+  public:
+    explicit RawSender(uint16_t port)
+      : m_socket(socket(AF_INET, SOCK_DGRAM, 0))
+      , m_address()
+    {
+      if (m_socket < 0) {
+        throw std::runtime_error("RawSender: cannot create socket");
+      }
+      m_address.sin_family = AF_INET;
+      m_address.sin_port = htons(port);
+      m_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    }
+
+    ~RawSender()
+    {
+      close(m_socket);
+    }
+
+    void send(const std::vector<uint8_t>& datagram)
+    {
+      sendto(m_socket, datagram.data(), datagram.size(), 0,
+        reinterpret_cast<const sockaddr*>(&m_address), sizeof(m_address));
+    }
+
+    // fragment fragmentIndex of a frame with one marker per fragment, whose
+    // x is the marker's index and y the frame number
+    void sendFragment(uint32_t frameNumber, uint16_t fragmentIndex, uint16_t fragmentCount,
+      int64_t stamp)
+    {
+      send(fragment(frameNumber, fragmentIndex, fragmentCount, stamp));
+    }
+
+    static std::vector<uint8_t> fragment(uint32_t frameNumber, uint16_t fragmentIndex,
+      uint16_t fragmentCount, int64_t stamp)
+    {
+      MarkerDatagramHeader header;
+      std::memcpy(header.magic, "LRBU", sizeof(header.magic));
+      header.version = MarkerDatagramVersion;
+      header.fragmentIndex = fragmentIndex;
+      header.fragmentCount = fragmentCount;
+      header.markersInFragment = 1;
+      header.frameNumber = frameNumber;
+      header.stamp = stamp;
+      header.numMarkers = fragmentCount;
+      header.firstMarker = fragmentIndex;
+      const float marker[3] = {float(fragmentIndex), float(frameNumber), 0};
+
+      std::vector<uint8_t> datagram(sizeof(header) + sizeof(marker));
+      std::memcpy(datagram.data(), &header, sizeof(header));
+      std::memcpy(datagram.data() + sizeof(header), marker, sizeof(marker));
+      return datagram;
+    }
+
+  private:
+    int m_socket;
+    sockaddr_in m_address;
+  };
+
+  void roundTrip()
+  {
+    UdpMarkerReceiver receiver(testPort(0), 1000);
+    // small datagrams, so that frames are fragmented
+    UdpMarkerSender sender("127.0.0.1", testPort(0), 200);
+
+    std::vector<float> xyz(3 * 500);
+    for (size_t i = 0; i < xyz.size(); ++i) {
+      xyz[i] = i;
+    }
+    for (int64_t f = 0; f < 3; ++f) {
+      CHECK(sender.send(stampAt(1000 * f), MarkerView(xyz.data(), 500 - f)));
+    }
+    // too many markers for one frame
+    std::vector<float> large(3 * 70000);
+    CHECK(!sender.send(stampAt(0), MarkerView(large.data(), 70000)));
+
+    std::vector<ReceivedFrame> frames = receiveAll(receiver);
+    if (!CHECK(frames.size() == 3)) {
+      return;
+    }
+    for (size_t f = 0; f < frames.size(); ++f) {
+      CHECK(frames[f].stamp == int64_t(1000 * f));
+      CHECK(frames[f].markers.size() == 3 * (500 - f));
+      CHECK(std::equal(frames[f].markers.begin(), frames[f].markers.end(), xyz.begin()));
+    }
+    const UdpReceiverStatistics& statistics = receiver.statistics();
+    CHECK(statistics.frames == 3);
+    CHECK(statistics.droppedFrames == 0);
+    CHECK(statistics.malformedDatagrams == 0);
+    CHECK(statistics.lateDatagrams == 0);
+  }
+
+  void reassemblesReorderedAndDuplicateFragments()
+  {
+    UdpMarkerReceiver receiver(testPort(1), 100);
+    RawSender sender(testPort(1));
+
+    // fragments of frames 10 and 11 interleaved and out of order
+    sender.sendFragment(10, 2, 3, 10);
+    sender.sendFragment(11, 1, 2, 11);
+    sender.sendFragment(10, 0, 3, 10);
+    // duplicate
+    sender.sendFragment(10, 0, 3, 10);
+    sender.sendFragment(10, 1, 3, 10);
+    sender.sendFragment(11, 0, 2, 11);
+    // duplicate of a delivered frame
+    sender.sendFragment(11, 1, 2, 11);
+
+    std::vector<ReceivedFrame> frames = receiveAll(receiver);
+    if (!CHECK(frames.size() == 2)) {
+      return;
+    }
+    CHECK(frames[0].stamp == 10 && frames[1].stamp == 11);
+    CHECK(frames[0].markers.size() == 9);
+    for (size_t i = 0; i < 3; ++i) {
+      CHECK(frames[0].markers[3 * i] == i && frames[0].markers[3 * i + 1] == 10);
+    }
+    CHECK(frames[1].markers.size() == 6 && frames[1].markers[3] == 1);
+
+    const UdpReceiverStatistics& statistics = receiver.statistics();
+    CHECK(statistics.datagrams == 7);
+    // frame 10's fragments after frame 11's first one
+    CHECK(statistics.reorderedDatagrams == 3);
+    CHECK(statistics.malformedDatagrams == 1);
+    CHECK(statistics.lateDatagrams == 1);
+    CHECK(statistics.droppedFrames == 0);
+  }
+
+  void givesUpOvertakenFrames()
+  {
+    UdpMarkerReceiver receiver(testPort(2), 100);
+    RawSender sender(testPort(2));
+
+    sender.sendFragment(20, 0, 2, 20);
+    // frames 21 and 22 lost, 23 complete
+    sender.sendFragment(23, 0, 1, 23);
+    // too late for frame 20
+    sender.sendFragment(20, 1, 2, 20);
+
+    std::vector<ReceivedFrame> frames = receiveAll(receiver);
+    CHECK(frames.size() == 1 && frames[0].stamp == 23);
+    const UdpReceiverStatistics& statistics = receiver.statistics();
+    CHECK(statistics.lateDatagrams == 1);
+    // the first delivered frame has no predecessor to count from
+    CHECK(statistics.droppedFrames == 0);
+
+    sender.sendFragment(26, 0, 1, 26);
+    frames = receiveAll(receiver);
+    CHECK(frames.size() == 1 && frames[0].stamp == 26);
+    CHECK(receiver.statistics().droppedFrames == 2);
+  }
+
+  void frameNumbersWrapAround()
+  {
+    UdpMarkerReceiver receiver(testPort(3), 100);
+    RawSender sender(testPort(3));
+
+    uint32_t const first = 0xfffffffe;
+    for (uint32_t i = 0; i < 4; ++i) {
+      sender.sendFragment(first + i, 0, 1, 100 + i);
+    }
+    // older than all of the above, despite the larger number
+    sender.sendFragment(first - 1, 0, 1, 99);
+
+    std::vector<ReceivedFrame> frames = receiveAll(receiver);
+    if (!CHECK(frames.size() == 4)) {
+      return;
+    }
+    for (size_t i = 0; i < frames.size(); ++i) {
+      CHECK(frames[i].stamp == int64_t(100 + i));
+    }
+    const UdpReceiverStatistics& statistics = receiver.statistics();
+    CHECK(statistics.droppedFrames == 0);
+    CHECK(statistics.lateDatagrams == 1);
+    CHECK(statistics.resyncs == 0);
+  }
+
+  void followsSenderRestart()
+  {
+    UdpMarkerReceiver receiver(testPort(4), 100);
+    RawSender sender(testPort(4));
+
+    for (uint32_t i = 100; i < 103; ++i) {
+      sender.sendFragment(i, 0, 1, i);
+    }
+    // restarted sender: numbering starts over, stamps go on
+    for (uint32_t i = 0; i < 3; ++i) {
+      sender.sendFragment(i, 0, 1, 1000 + i);
+    }
+    std::vector<ReceivedFrame> frames = receiveAll(receiver);
+    CHECK(frames.size() == 6);
+    CHECK(receiver.statistics().resyncs == 1);
+    CHECK(receiver.statistics().lateDatagrams == 0);
+
+    // a sender that jumped far back, even with stale stamps
+    for (uint32_t i = 0; i < 3; ++i) {
+      sender.sendFragment(5000 + i, 0, 1, 2000 + i);
+    }
+    sender.sendFragment(7, 0, 1, 0);
+    frames = receiveAll(receiver);
+    CHECK(frames.size() == 4);
+    CHECK(receiver.statistics().resyncs == 2);
+  }
+
+  void rejectsMalformedDatagrams()
+  {
+    UdpMarkerReceiver receiver(testPort(5), 4);
+    RawSender sender(testPort(5));
+
+    std::vector<uint8_t> const valid = RawSender::fragment(1, 0, 1, 1);
+    // shorter than the header
+    sender.send(std::vector<uint8_t>(valid.begin(), valid.begin() + 10));
+    // truncated marker data
+    sender.send(std::vector<uint8_t>(valid.begin(), valid.end() - 4));
+    // trailing bytes
+    std::vector<uint8_t> datagram = valid;
+    datagram.push_back(0);
+    sender.send(datagram);
+
+    MarkerDatagramHeader header;
+    std::memcpy(&header, valid.data(), sizeof(header));
+    auto sendModified = [&](const MarkerDatagramHeader& modified) {
+      std::vector<uint8_t> d = valid;
+      std::memcpy(d.data(), &modified, sizeof(modified));
+      sender.send(d);
+    };
+    MarkerDatagramHeader h = header;
+    h.magic[0] = 'X';
+    sendModified(h);
+    h = header;
+    h.version = MarkerDatagramVersion + 1;
+    sendModified(h);
+    h = header;
+    h.fragmentIndex = 1;
+    sendModified(h);
+    h = header;
+    h.fragmentCount = 0;
+    sendModified(h);
+    h = header;
+    h.fragmentCount = MaxFragmentsPerFrame + 1;
+    sendModified(h);
+    // beyond the frame's markers
+    h = header;
+    h.firstMarker = 1;
+    sendModified(h);
+    // more markers than the receiver accepts
+    h = header;
+    h.numMarkers = 5;
+    sendModified(h);
+
+    std::vector<ReceivedFrame> frames = receiveAll(receiver);
+    CHECK(frames.empty());
+    CHECK(receiver.statistics().datagrams == 10);
+    CHECK(receiver.statistics().malformedDatagrams == 10);
+
+    // a fragment disagreeing with the frame's other fragments
+    sender.sendFragment(2, 0, 2, 2);
+    h = header;
+    h.frameNumber = 2;
+    h.fragmentIndex = 1;
+    h.fragmentCount = 3;
+    h.numMarkers = 3;
+    h.firstMarker = 1;
+    sendModified(h);
+    frames = receiveAll(receiver);
+    CHECK(frames.empty());
+    CHECK(receiver.statistics().malformedDatagrams == 11);
+
+    sender.send(valid);
+    frames = receiveAll(receiver);
+    CHECK(frames.size() == 1);
+  }
+
+} // anonymous namespace
+
+int main()
+{
+  RUN_TEST(roundTrip);
+  RUN_TEST(reassemblesReorderedAndDuplicateFragments);
+  RUN_TEST(givesUpOvertakenFrames);
+  RUN_TEST(frameNumbersWrapAround);
+  RUN_TEST(followsSenderRestart);
+  RUN_TEST(rejectsMalformedDatagrams);
+  return TEST_MAIN_RESULT();
+}